@@ -0,0 +1,24 @@
+// Light lists of the clusters built by light_clusters.comp, for the forward passes.
+// Must be included after structs.glsl
+
+layout(binding = 3) uniform LightClusters {
+    LightClusterData clusters;
+};
+
+// Offset and count of the lights of each cluster in cluster_light_indices
+layout(std430, binding = 0) readonly buffer ClusterLights {
+    uvec2 cluster_lights[];
+};
+
+layout(std430, binding = 7) readonly buffer ClusterLightIndices {
+    uint cluster_light_indices[];
+};
+
+// Offset and count of the lights that can reach a fragment
+uvec2 cluster_light_range(vec2 frag_coord, vec3 position) {
+    const float dist = -(clusters.view * vec4(position, 1.0)).z;
+    const float slice_dist = log(max(dist, clusters.slice_near) / clusters.slice_near) * clusters.slice_scale;
+    const uint slice = min(uint(slice_dist), clusters.slice_count - 1);
+    const uvec2 tile = min(uvec2(frag_coord) / clusters.tile_size, clusters.tile_count - 1);
+    return cluster_lights[(slice * clusters.tile_count.y + tile.y) * clusters.tile_count.x + tile.x];
+}
@@ -16,6 +16,8 @@ layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
+#include "irradiance.glsl"
+
 vec3 ambient = vec3(0.0);
 
 void main() {
@@ -25,7 +27,11 @@ void main() {
     float depth = texelFetch(in_depth, coord, 0).x;
 
     if (depth > 0.0) {
-        vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient;
+        const vec2 ndc = gl_FragCoord.xy / vec2(textureSize(in_depth, 0)) * 2.0 - 1.0;
+        const vec4 p = frame.camera.inv_view_proj * vec4(ndc, depth, 1.0);
+        const vec3 position = p.xyz / p.w;
+
+        vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient + baked_irradiance(position, normal);
 
         out_color = vec4(albedo * acc, 1.0);
     }
@@ -0,0 +1,7 @@
+#version 450
+
+// Depth is written by the fixed function pipeline
+
+void main() {
+}
+
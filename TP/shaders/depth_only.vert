@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "utils.glsl"
+#include "instances.glsl"
+
+layout(location = 0) in vec3 in_pos;
+
+layout(binding = 0) uniform Data {
+    FrameData frame;
+};
+
+// Must match basic.vert exactly for the DepthTestMode::Equal pass that follows
+invariant gl_Position;
+
+void main() {
+    const mat4 model = instance_model(uint(gl_InstanceID));
+    const vec4 position = model * vec4(in_pos, 1.0);
+
+    gl_Position = frame.camera.view_proj * position;
+}
+
@@ -1,6 +1,7 @@
 #version 450
 
 #include "utils.glsl"
+#include "materials.glsl"
 
 // fragment shader of the main lighting pass
 
@@ -15,9 +16,10 @@ layout(location = 2) in vec3 in_color;
 layout(location = 3) in vec3 in_position;
 layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
+layout(location = 6) flat in uint in_material;
 
-layout(binding = 0) uniform sampler2D in_texture;
-layout(binding = 1) uniform sampler2D in_normal_texture;
+layout(binding = 0) uniform sampler2DArray in_texture;
+layout(binding = 1) uniform sampler2DArray in_normal_texture;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
@@ -30,10 +32,11 @@ layout(binding = 1) buffer PointLights {
 const vec3 ambient = vec3(0.0);
 
 void main() {
-    out_albedo = vec4(in_color, 1.0);
+    const MaterialData material = materials[in_material];
+    out_albedo = vec4(in_color, 1.0) * material.base_color_factor;
 
 #ifdef TEXTURED
-    out_albedo *= texture(in_texture, in_uv);
+    out_albedo *= texture(in_texture, vec3(in_uv, float(material.albedo_layer)));
 #endif
     
     out_normal = vec4(normalize(in_normal), 1.0);
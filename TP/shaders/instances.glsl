@@ -0,0 +1,59 @@
+// Instance transforms, see TransformFormat in Scene.h
+
+#define TRANSFORM_AFFINE 0
+#define TRANSFORM_COMPACT 1
+
+layout(binding = 2) buffer AffineTransforms {
+    AffineTransform affine_transforms[];
+};
+
+layout(binding = 4) buffer CompactTransforms {
+    CompactTransform compact_transforms[];
+};
+
+// Visible instances of all draws
+layout(binding = 3) buffer Instances {
+    InstanceData instances[];
+};
+
+// Draws issued by a multi draw are consecutive, requires GL_ARB_shader_draw_parameters
+layout(binding = 5) buffer Draws {
+    DrawData draws[];
+};
+
+uniform uint draw_offset;
+
+mat3 quat_to_mat3(vec4 q) {
+    const vec3 q2 = q.xyz * 2.0;
+    const vec3 diag = q.xyz * q2;
+    const float xy = q.x * q2.y;
+    const float xz = q.x * q2.z;
+    const float yz = q.y * q2.z;
+    const vec3 w = q.w * q2;
+    return mat3(
+        1.0 - diag.y - diag.z, xy + w.z, xz - w.y,
+        xy - w.z, 1.0 - diag.x - diag.z, yz + w.x,
+        xz + w.y, yz - w.x, 1.0 - diag.x - diag.y
+    );
+}
+
+DrawData current_draw() {
+    return draws[draw_offset + uint(gl_DrawIDARB)];
+}
+
+InstanceData instance_data(uint instance) {
+    return instances[current_draw().first_instance + instance];
+}
+
+mat4 instance_model(uint instance) {
+    const DrawData draw = current_draw();
+    const uint index = instances[draw.first_instance + instance].transform;
+    if(draw.transform_format == TRANSFORM_COMPACT) {
+        const CompactTransform tr = compact_transforms[index];
+        const mat3 basis = quat_to_mat3(tr.rotation) * tr.scale;
+        return mat4(vec4(basis[0], 0.0), vec4(basis[1], 0.0), vec4(basis[2], 0.0), vec4(tr.translation, 1.0));
+    }
+
+    const AffineTransform tr = affine_transforms[index];
+    return transpose(mat4(tr.rows[0], tr.rows[1], tr.rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
+}
@@ -0,0 +1,26 @@
+// Irradiance of the baked static lights, an ambient cube per probe (see IrradianceVolume).
+// The faces (+X, -X, +Y, -Y, +Z, -Z) are stacked along z in a single 3D texture.
+// Must be included after the declaration of frame
+
+layout(binding = 3) uniform sampler3D in_irradiance;
+
+// One filtered fetch per axis of the normal, whatever the number of baked lights
+vec3 baked_irradiance(vec3 position, vec3 normal) {
+    if(frame.irradiance_enabled == 0) {
+        return vec3(0.0);
+    }
+
+    const vec3 uvw = saturate((position - frame.irradiance_min) * frame.irradiance_inv_extent);
+    const float depth = float(textureSize(in_irradiance, 0).z);
+    const float probes_z = depth / 6.0;
+    // Filtered within the slab of the face only
+    const float z = clamp(uvw.z * probes_z, 0.5, probes_z - 0.5);
+
+    const vec3 weights = normal * normal;
+    vec3 irradiance = vec3(0.0);
+    for(int axis = 0; axis != 3; ++axis) {
+        const float face = float(axis * 2 + (normal[axis] < 0.0 ? 1 : 0));
+        irradiance += weights[axis] * texture(in_irradiance, vec3(uvw.xy, (face * probes_z + z) / depth)).rgb;
+    }
+    return irradiance;
+}
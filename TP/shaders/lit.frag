@@ -1,8 +1,11 @@
 #version 450
 
 #include "utils.glsl"
+#include "materials.glsl"
 
-// fragment shader of the main lighting pass
+// fragment shader of the Forward+ opaque pass, drawn over the depth pre-pass.
+// Lights the fragment with the sun and the lights of its screen tile, built by Scene::cull_lights.
+// Reads the same material inputs as g_buffer.frag, but the normal is not quantized to the G-buffer format.
 
 // #define DEBUG_NORMAL
 
@@ -14,55 +17,67 @@ layout(location = 2) in vec3 in_color;
 layout(location = 3) in vec3 in_position;
 layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
+layout(location = 6) flat in uint in_material;
 
-layout(binding = 0) uniform sampler2D in_texture;
-layout(binding = 1) uniform sampler2D in_normal_texture;
+layout(binding = 0) uniform sampler2DArray in_texture;
+layout(binding = 1) uniform sampler2DArray in_normal_texture;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
-layout(binding = 1) buffer PointLights {
+#include "irradiance.glsl"
+
+layout(binding = 4) uniform TileGrid {
+    uint tile_size;
+    uint tiles_per_row;
+};
+
+layout(std430, binding = 1) readonly buffer PointLights {
     PointLight point_lights[];
 };
 
+// Offset and count of the lights of each tile in tile_light_indices.
+// Not at the bindings of the tiled passes, which are used by the instance data here.
+layout(std430, binding = 0) readonly buffer TileLights {
+    uvec2 tile_lights[];
+};
+
+layout(std430, binding = 7) readonly buffer TileLightIndices {
+    uint tile_light_indices[];
+};
+
 const vec3 ambient = vec3(0.0);
 
 void main() {
-#ifdef NORMAL_MAPPED
-    const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, in_uv).xy);
-    const vec3 normal = normal_map.x * in_tangent +
-                        normal_map.y * in_bitangent +
-                        normal_map.z * in_normal;
-#else
-    const vec3 normal = in_normal;
+    const MaterialData material = materials[in_material];
+    vec4 albedo = vec4(in_color, 1.0) * material.base_color_factor;
+
+#ifdef TEXTURED
+    albedo *= texture(in_texture, vec3(in_uv, float(material.albedo_layer)));
 #endif
 
-    vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient;
-    
-    for(uint i = 0; i != frame.point_light_count; ++i) {
-        PointLight light = point_lights[i];
+    const vec3 normal = normalize(in_normal);
+
+    vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient + baked_irradiance(in_position, normal);
+
+    const uvec2 tile = uvec2(gl_FragCoord.xy) / tile_size;
+    const uvec2 light_range = tile_lights[tile.y * tiles_per_row + tile.x];
+    for(uint i = light_range.x; i != light_range.x + light_range.y; ++i) {
+        const PointLight light = point_lights[tile_light_indices[i]];
         const vec3 to_light = (light.position - in_position);
         const float dist = length(to_light);
         const vec3 light_vec = to_light / dist;
 
-        const float NoL = dot(light_vec, normal);
+        const float NoL = max(0.0, dot(light_vec, normal));
         const float att = attenuation(dist, light.radius) * light.intensity;
-        if(NoL <= 0.0 || att <= 0.0f) {
-            continue;
-        }
 
-        acc += light.color * (NoL * att);
+        acc += light.color * NoL * att;
     }
 
-    out_color = vec4(in_color * acc, 1.0);
-
-#ifdef TEXTURED
-    out_color *= texture(in_texture, in_uv);
-#endif
+    out_color = vec4(albedo.rgb * acc, 1.0);
 
 #ifdef DEBUG_NORMAL
     out_color = vec4(normal * 0.5 + 0.5, 1.0);
 #endif
 }
-
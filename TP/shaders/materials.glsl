@@ -0,0 +1,5 @@
+// Material table of the scene, see Scene::register_material
+
+layout(binding = 6) buffer Materials {
+    MaterialData materials[];
+};
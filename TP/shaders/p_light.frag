@@ -2,7 +2,11 @@
 
 #include "utils.glsl"
 
-layout(location = 0) in vec2 in_uv;
+// Additive contribution of a light volume, drawn with its back faces and the depth test reversed
+// so that the surfaces behind the volume are rejected before shading
+
+layout(location = 0) flat in uint in_light;
+layout(location = 1) flat in float in_front_depth;
 
 layout(location = 0) out vec4 out_color;
 
@@ -16,8 +20,8 @@ layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
-layout(binding = 1) uniform PLightData {
-    PointLight point_light;
+layout(std430, binding = 1) readonly buffer PointLights {
+    PointLight point_lights[];
 };
 
 vec3 unproject(vec2 uv, float depth, mat4 inv_view_proj) {
@@ -28,25 +32,33 @@ vec3 unproject(vec2 uv, float depth, mat4 inv_view_proj) {
 
 void main() {
     ivec2 coord = ivec2(gl_FragCoord.xy);
-    vec3 albedo = texelFetch(in_albedo, coord, 0).xyz;
-    vec3 normal = texelFetch(in_normal, coord, 0).xyz;
     float depth = texelFetch(in_depth, coord, 0).x;
 
-    if (depth > 0.0) {
-        vec3 position = unproject(coord / window_size, depth, frame.camera.inv_view_proj);
+    // Depth bounds: surfaces in front of the volume (reverse-Z, nearer is larger)
+    if(depth > in_front_depth) {
+        discard;
+    }
+
+    const PointLight point_light = point_lights[in_light];
+    const vec3 position = unproject(coord / window_size, depth, frame.camera.inv_view_proj);
+
+    const vec3 to_light = (point_light.position - position);
+    const float dist = length(to_light);
 
-        const vec3 to_light = (point_light.position - position);
-        const float dist = length(to_light);
+    // Inside the depth bounds but outside of the sphere
+    if(dist >= point_light.radius) {
+        discard;
+    }
+
+    vec3 albedo = texelFetch(in_albedo, coord, 0).xyz;
+    vec3 normal = texelFetch(in_normal, coord, 0).xyz;
 
-        const vec3 light_vec = to_light / dist;
+    const vec3 light_vec = to_light / dist;
 
-        const float NoL = max(0.0, dot(light_vec, normal));
-        const float att = attenuation(dist, point_light.radius) * point_light.intensity;
+    const float NoL = max(0.0, dot(light_vec, normal));
+    const float att = attenuation(dist, point_light.radius) * point_light.intensity;
 
-        vec3 lit = point_light.color * NoL * att;
+    vec3 lit = point_light.color * NoL * att;
 
-        out_color = vec4(albedo * lit, 1.0);
-    }
-    else
-        out_color = vec4(vec3(0.0), 1.0);
-}
\ No newline at end of file
+    out_color = vec4(albedo * lit, 1.0);
+}
@@ -11,6 +11,12 @@ struct FrameData {
 
     vec3 sun_color;
     float padding_1;
+
+    // Bounds of the irradiance volume of the static lights, see irradiance.glsl
+    vec3 irradiance_min;
+    uint irradiance_enabled;
+    vec3 irradiance_inv_extent;
+    float padding_2;
 };
 
 struct PointLight {
@@ -20,6 +26,56 @@ struct PointLight {
     float intensity;
 };
 
+// Affine transform as the first three rows of the matrix
+struct AffineTransform {
+    vec4 rows[3];
+};
+
+// Rotation quaternion (xyzw), translation and uniform scale
+struct CompactTransform {
+    vec4 rotation;
+    vec3 translation;
+    float scale;
+};
+
+// Per draw data of the instanced passes, see instances.glsl
+struct DrawData {
+    uint first_instance;
+    uint transform_format;
+};
+
+struct InstanceData {
+    // Index in the transforms of the draw format
+    uint transform;
+    // Index in the scene material table
+    uint material;
+};
+
+// Texture layers are sampled from the arrays bound by the material
+struct MaterialData {
+    vec4 base_color_factor;
+    uint albedo_layer;
+    uint normal_layer;
+    uint padding_0;
+    uint padding_1;
+};
+
+// Clustered light lists: screen tiles split in slices of view distance, see clusters.glsl
+struct LightClusterData {
+    mat4 view;
+    vec2 tan_half_fov;
+    vec2 window_size;
+    uvec2 tile_count;
+    uint tile_size;
+    uint slice_count;
+    // Slices are exponential in view distance, closer fragments go to the first slice
+    float slice_near;
+    // Slices per unit of log(distance / slice_near)
+    float slice_scale;
+    uint padding_0;
+    uint padding_1;
+};
+
 struct AdvancedCameraData {
     vec3 position; 
     vec3 forward;
@@ -0,0 +1,21 @@
+// Size of the screen tiles of the tiled light passes, also their workgroup size.
+// Selected with the TILE_SIZE_8 or TILE_SIZE_32 defines, 16 otherwise.
+
+#if defined(TILE_SIZE_8)
+#define TILE_SIZE 8
+#elif defined(TILE_SIZE_32)
+#define TILE_SIZE 32
+#else
+#define TILE_SIZE 16
+#endif
+
+// Classes of tile_classification.comp, each is shaded by its own tiled.comp variant.
+// Must match OM3D::TileClass in Scene.h
+#define TILE_CLASS_SKY 0
+#define TILE_CLASS_SUN 1
+#define TILE_CLASS_FEW_LIGHTS 2
+#define TILE_CLASS_MANY_LIGHTS 3
+#define TILE_CLASS_COUNT 4
+
+// Tiles with at most this many lights read them straight from the light buffer
+#define FEW_TILE_LIGHTS 16
@@ -1,6 +1,8 @@
 #version 450
 
 #include "utils.glsl"
+#include "materials.glsl"
+#include "clusters.glsl"
 
 // fragment shader of the main lighting pass
 
@@ -15,11 +17,12 @@ layout(location = 3) in vec3 in_position;
 layout(location = 4) in vec3 in_tangent;
 layout(location = 5) in vec3 in_bitangent;
 layout(location = 6) in float depth; 
+layout(location = 7) flat in uint in_material;
 
 layout(offset = 0, binding = 0) uniform atomic_uint counter;
 
-layout(binding = 0) uniform sampler2D in_texture;
-layout(binding = 1) uniform sampler2D in_normal_texture;
+layout(binding = 0) uniform sampler2DArray in_texture;
+layout(binding = 1) uniform sampler2DArray in_normal_texture;
 layout(binding = 2) uniform sampler2D in_depth;
 
 layout(binding = 2) uniform StorageSize {
@@ -33,6 +36,8 @@ layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
+#include "irradiance.glsl"
+
 layout(binding = 1) buffer PointLights {
     PointLight point_lights[];
 };
@@ -45,8 +50,10 @@ void main() {
     if (gl_FragCoord.z <= depth_z)
         discard;
 
+    const MaterialData material = materials[in_material];
+
 #ifdef NORMAL_MAPPED
-    const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, in_uv).xy);
+    const vec3 normal_map = unpack_normal_map(texture(in_normal_texture, vec3(in_uv, float(material.normal_layer))).xy);
     const vec3 normal = normal_map.x * in_tangent +
                         normal_map.y * in_bitangent +
                         normal_map.z * in_normal;
@@ -54,10 +61,12 @@ void main() {
     const vec3 normal = in_normal;
 #endif
 
-    vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient;
+    vec3 acc = frame.sun_color * max(0.0, dot(frame.sun_dir, normal)) + ambient + baked_irradiance(in_position, normal);
     
-    for(uint i = 0; i != frame.point_light_count; ++i) {
-        PointLight light = point_lights[i];
+    // Only the lights of the cluster of the fragment can reach it
+    const uvec2 light_range = cluster_light_range(gl_FragCoord.xy, in_position);
+    for(uint i = light_range.x; i != light_range.x + light_range.y; ++i) {
+        PointLight light = point_lights[cluster_light_indices[i]];
         const vec3 to_light = (light.position - in_position);
         const float dist = length(to_light);
         const vec3 light_vec = to_light / dist;
@@ -71,10 +80,10 @@ void main() {
         acc += light.color * (NoL * att);
     }
 
-    out_color = vec4(in_color * acc, 1.0);
+    out_color = vec4(in_color * acc, 1.0) * material.base_color_factor;
 
 #ifdef TEXTURED
-    out_color *= texture(in_texture, in_uv);
+    out_color *= texture(in_texture, vec3(in_uv, float(material.albedo_layer)));
 #endif
 
 #ifdef DEBUG_NORMAL
@@ -1,6 +1,8 @@
 #version 450
+#extension GL_ARB_shader_draw_parameters : require
 
 #include "utils.glsl"
+#include "instances.glsl"
 
 layout(location = 0) in vec3 in_pos;
 layout(location = 1) in vec3 in_normal;
@@ -15,6 +17,7 @@ layout(location = 3) out vec3 out_position;
 layout(location = 4) out vec3 out_tangent;
 layout(location = 5) out vec3 out_bitangent;
 layout(location = 6) out float depth;
+layout(location = 7) flat out uint out_material;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
@@ -24,13 +27,8 @@ layout(binding = 1) uniform CameraPosition {
     vec3 camera_pos; 
 };
 
-layout(binding = 2) buffer Models {
-    mat4 models[];
-};
-
-
 void main() {
-    mat4 model = models[gl_InstanceID];
+    const mat4 model = instance_model(uint(gl_InstanceID));
     const vec4 position = model * vec4(in_pos, 1.0);
 
     out_normal = normalize(mat3(model) * in_normal);
@@ -39,6 +37,7 @@ void main() {
 
     out_uv = in_uv;
     out_color = in_color;
+    out_material = instance_data(uint(gl_InstanceID)).material;
     out_position = position.xyz;
     depth = length(camera_pos - position.xyz);
     gl_Position = frame.camera.view_proj * position;
@@ -24,6 +24,7 @@ float luminance(vec3 rgb) {
     return dot(rgb, vec3(0.2126, 0.7152, 0.0722));
 }
 
+// Same falloff as OM3D::attenuation() in PointLight.h, used by the light LOD and the irradiance bake
 float attenuation(float distance, float radius) {
     const float x = min(distance, radius);
     return sqr(1.0 - sqr(sqr(x / radius))) / (sqr(x) + 1.0);
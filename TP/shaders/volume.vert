@@ -2,26 +2,39 @@
 
 #include "utils.glsl"
 
+// Light volumes, one instance of the sphere mesh per visible light
+
 layout(location = 0) in vec3 in_pos;
-layout(location = 2) in vec2 in_uv;
 
-layout(location = 0) out vec2 out_uv;
+layout(location = 0) flat out uint out_light;
+layout(location = 1) flat out float out_front_depth;
 
 layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
-layout(binding = 1) uniform PLightData {
-    PointLight point_light;
+layout(std430, binding = 1) readonly buffer PointLights {
+    PointLight point_lights[];
 };
 
-layout(binding = 2) uniform Model {
-    mat4 model;
+// Light of each instance
+layout(std430, binding = 3) readonly buffer VisibleLights {
+    uint visible_lights[];
 };
 
-void main() {
-    vec4 position = model * vec4(in_pos, 1.0);
-    gl_Position = frame.camera.view_proj * position;
+// sphere.glb is an icosphere inscribed in the unit sphere, its faces are 0.934 from the center
+const float volume_scale = 1.0 / 0.934;
 
-    out_uv = in_uv;
-}
\ No newline at end of file
+void main() {
+    const uint light_index = visible_lights[gl_InstanceID];
+    const PointLight light = point_lights[light_index];
+
+    gl_Position = frame.camera.view_proj * vec4(light.position + in_pos * (light.radius * volume_scale), 1.0);
+
+    // Depth of the nearest point of the light sphere, with reverse-Z and an infinite far plane
+    // the depth is z / distance, where z is the same for all points and w is the view distance
+    const vec4 center = frame.camera.view_proj * vec4(light.position, 1.0);
+    const float front_dist = center.w - light.radius;
+    out_front_depth = front_dist > 0.0 ? center.z / front_dist : 1.0;
+    out_light = light_index;
+}
@@ -35,7 +35,7 @@ namespace OM3D
 
     void ByteBuffer::bind(BufferUsage usage, u32 index) const
     {
-        ALWAYS_ASSERT(usage == BufferUsage::Uniform || usage == BufferUsage::Storage, "Index bind is only available for uniform and storage buffers");
+        ALWAYS_ASSERT(usage == BufferUsage::Uniform || usage == BufferUsage::Storage || usage == BufferUsage::Atomic_counter, "Index bind is only available for uniform, storage and atomic counter buffers");
         glBindBufferBase(buffer_usage_to_gl(usage), index, _handle.get());
     }
 
@@ -49,6 +49,17 @@ namespace OM3D
         return BufferMapping<byte>(map_internal(access), byte_size(), handle());
     }
 
+    void ByteBuffer::clear()
+    {
+        glClearNamedBufferData(_handle.get(), GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    void ByteBuffer::update_bytes(size_t offset, const void *data, size_t size)
+    {
+        DEBUG_ASSERT(offset + size <= _size);
+        glNamedBufferSubData(_handle.get(), offset, size, data);
+    }
+
     void *ByteBuffer::map_internal(AccessType access)
     {
         DEBUG_ASSERT(_handle.is_valid() && _size);
@@ -60,13 +71,4 @@ namespace OM3D
         return _handle;
     }
 
-    void ByteBuffer::bind_atomic_buffer(uint &atomics_buffer, uint &counter)
-    {
-        glGenBuffers(1, &atomics_buffer);
-        // bind the buffer and define its initial storage capacity
-        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, atomics_buffer);
-        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(uint), &counter, GL_DYNAMIC_DRAW);
-        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, atomics_buffer);
-    }
-
 }
@@ -22,10 +22,11 @@ class ByteBuffer : NonCopyable {
         size_t byte_size() const;
 
         BufferMapping<byte> map_bytes(AccessType access = AccessType::ReadWrite);
+        void update_bytes(size_t offset, const void* data, size_t size);
+        // Set all the bytes to 0, on the GPU
+        void clear();
         const GLHandle& handle() const;
 
-        static void bind_atomic_buffer(uint &atomics_buffer, uint& counter);
-
     protected:
         void* map_internal(AccessType access);
     
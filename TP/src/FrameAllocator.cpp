@@ -0,0 +1,126 @@
+#include "FrameAllocator.h"
+
+namespace OM3D {
+
+static GLuint create_buffer_handle() {
+    GLuint handle = 0;
+    glCreateBuffers(1, &handle);
+    return handle;
+}
+
+static constexpr GLbitfield mapping_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+static void delete_buffer(GLHandle& buffer) {
+    if(auto handle = buffer.get()) {
+        glUnmapNamedBuffer(handle);
+        glDeleteBuffers(1, &handle);
+    }
+    buffer = GLHandle();
+}
+
+FrameAllocator::FrameAllocator(size_t frame_byte_size) {
+    GLint uniform_alignment = 0;
+    GLint storage_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+
+    // Any allocation can be bound as any buffer type, 16 covers std140/std430 and all scalar types
+    _alignment = std::max({size_t(uniform_alignment), size_t(storage_alignment), size_t(16)});
+    create_buffer(frame_byte_size);
+}
+
+FrameAllocator::~FrameAllocator() {
+    for(u32 i = 0; i != frames_in_flight; ++i) {
+        if(GLsync fence = _fences[i]) {
+            glDeleteSync(fence);
+        }
+        for(GLHandle& buffer : _overflow_buffers[i]) {
+            delete_buffer(buffer);
+        }
+    }
+    delete_buffer(_handle);
+}
+
+void FrameAllocator::create_buffer(size_t frame_byte_size) {
+    delete_buffer(_handle);
+
+    _frame_size = align_up_to(u32(frame_byte_size), u32(_alignment));
+    _handle = GLHandle(create_buffer_handle());
+    glNamedBufferStorage(_handle.get(), _frame_size * frames_in_flight, nullptr, mapping_flags);
+    _mapping = static_cast<byte*>(glMapNamedBufferRange(_handle.get(), 0, _frame_size * frames_in_flight, mapping_flags));
+    ALWAYS_ASSERT(_mapping, "Unable to map frame buffer");
+}
+
+void FrameAllocator::wait_for_frame(u32 frame_index) {
+    if(GLsync& fence = _fences[frame_index]) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    for(GLHandle& buffer : _overflow_buffers[frame_index]) {
+        delete_buffer(buffer);
+    }
+    _overflow_buffers[frame_index].clear();
+}
+
+void FrameAllocator::begin_frame() {
+    DEBUG_ASSERT(!_in_frame);
+
+    // A frame didn't fit: once all the frames are retired, grow the regions with some margin
+    if(_required_size > _frame_size) {
+        for(u32 i = 0; i != frames_in_flight; ++i) {
+            wait_for_frame(i);
+        }
+        create_buffer(_required_size + _required_size / 2);
+    }
+
+    _frame_index = (_frame_index + 1) % frames_in_flight;
+    _offset = 0;
+    _in_frame = true;
+
+    wait_for_frame(_frame_index);
+}
+
+void FrameAllocator::end_frame() {
+    DEBUG_ASSERT(_in_frame);
+
+    _fences[_frame_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _in_frame = false;
+}
+
+FrameAllocator::Range FrameAllocator::allocate_bytes(size_t size) {
+    ALWAYS_ASSERT(_in_frame, "Frame allocations must happen between begin_frame and end_frame");
+
+    const size_t begin = (_offset + _alignment - 1) / _alignment * _alignment;
+    _offset = begin + size;
+    _required_size = std::max(_required_size, _offset);
+
+    if(_offset <= _frame_size) {
+        const size_t offset = _frame_index * _frame_size + begin;
+        return {_handle.get(), offset, _mapping + offset};
+    }
+
+    // Doesn't fit in the region, only for this frame
+    GLHandle buffer(create_buffer_handle());
+    glNamedBufferStorage(buffer.get(), size, nullptr, mapping_flags);
+    byte* mapping = static_cast<byte*>(glMapNamedBufferRange(buffer.get(), 0, size, mapping_flags));
+    ALWAYS_ASSERT(mapping, "Unable to map frame buffer");
+
+    const u32 handle = buffer.get();
+    _overflow_buffers[_frame_index].push_back(std::move(buffer));
+    return {handle, 0, mapping};
+}
+
+size_t FrameAllocator::frame_byte_size() const {
+    return _frame_size;
+}
+
+u32 FrameAllocator::frame_index() const {
+    return _frame_index;
+}
+
+size_t FrameAllocator::used_byte_size() const {
+    return _offset;
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef FRAMEALLOCATOR_H
+#define FRAMEALLOCATOR_H
+
+#include <graphics.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace OM3D {
+
+// Sub-range of the frame ring buffer. Only valid until the end of the frame it was allocated in.
+template<typename T>
+class FrameAllocation {
+    public:
+        FrameAllocation() = default;
+
+        T* data() const {
+            return _data;
+        }
+
+        size_t element_count() const {
+            return _count;
+        }
+
+        size_t byte_size() const {
+            return _count * sizeof(T);
+        }
+
+        T& operator[](size_t index) const {
+            DEBUG_ASSERT(index < element_count());
+            return _data[index];
+        }
+
+        void bind(BufferUsage usage, u32 index) const {
+            // Empty ranges can't be bound, allocations always reserve at least one element
+            glBindBufferRange(buffer_usage_to_gl(usage), index, _buffer, GLintptr(_offset), GLsizeiptr(std::max(byte_size(), sizeof(T))));
+        }
+
+        void bind(BufferUsage usage) const {
+            glBindBuffer(buffer_usage_to_gl(usage), _buffer);
+        }
+
+        // Offset in the buffer bound by bind(usage), used by indirect draws
+        size_t byte_offset() const {
+            return _offset;
+        }
+
+    private:
+        friend class FrameAllocator;
+
+        T* _data = nullptr;
+        size_t _count = 0;
+        u32 _buffer = 0;
+        size_t _offset = 0;
+};
+
+// Linear allocator for per-frame GPU data (constants, lights, instance data, ...).
+// A single buffer is mapped once (persistent + coherent) and split in one region per
+// frame in flight. Each region is fenced at the end of its frame and only reused once
+// the GPU is done with it, so writing into allocations never stalls nor needs a flush.
+// Allocations that don't fit in the region get their own buffer, freed with the region,
+// and the regions are grown at the start of the next frame.
+class FrameAllocator : NonCopyable {
+    public:
+        static constexpr u32 frames_in_flight = 3;
+
+        FrameAllocator(size_t frame_byte_size = 8 * 1024 * 1024);
+        ~FrameAllocator();
+
+        // Wait for the GPU to be done with the next region and start allocating from it
+        void begin_frame();
+        void end_frame();
+
+        template<typename T>
+        FrameAllocation<T> allocate(size_t count) {
+            const Range range = allocate_bytes(std::max(count, size_t(1)) * sizeof(T));
+            FrameAllocation<T> alloc;
+            alloc._count = count;
+            alloc._buffer = range.buffer;
+            alloc._offset = range.offset;
+            alloc._data = reinterpret_cast<T*>(range.data);
+            return alloc;
+        }
+
+        template<typename T>
+        FrameAllocation<T> allocate(Span<const T> data) {
+            FrameAllocation<T> alloc = allocate<T>(data.size());
+            std::copy(data.begin(), data.end(), alloc.data());
+            return alloc;
+        }
+
+        size_t frame_byte_size() const;
+        // Region of the current frame, in [0, frames_in_flight)
+        u32 frame_index() const;
+        // Bytes allocated in the current frame, can exceed frame_byte_size
+        size_t used_byte_size() const;
+
+    private:
+        struct Range {
+            u32 buffer = 0;
+            size_t offset = 0;
+            byte* data = nullptr;
+        };
+
+        Range allocate_bytes(size_t size);
+
+        void create_buffer(size_t frame_byte_size);
+        void wait_for_frame(u32 frame_index);
+
+        GLHandle _handle;
+        byte* _mapping = nullptr;
+        size_t _frame_size = 0;
+        size_t _alignment = 0;
+        // Largest frame seen, the regions grow to fit it
+        size_t _required_size = 0;
+
+        u32 _frame_index = 0;
+        size_t _offset = 0;
+        bool _in_frame = false;
+        std::array<GLsync, frames_in_flight> _fences = {};
+        // Buffers of the allocations that didn't fit in the region of each frame
+        std::array<std::vector<GLHandle>, frames_in_flight> _overflow_buffers;
+};
+
+}
+
+#endif // FRAMEALLOCATOR_H
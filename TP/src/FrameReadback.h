@@ -0,0 +1,55 @@
+#ifndef FRAMEREADBACK_H
+#define FRAMEREADBACK_H
+
+#include <FrameAllocator.h>
+#include <ByteBuffer.h>
+
+namespace OM3D {
+
+// Values copied from GPU buffers and read on the CPU without stalling. There is one persistently mapped
+// slot per frame in flight. The slot of a frame is read back the next time its frame allocator region
+// is used: begin_frame has then waited for the fence of the frame that wrote it.
+template<typename T>
+class FrameReadback : NonCopyable {
+    public:
+        FrameReadback() = default;
+
+        ~FrameReadback() {
+            if(auto handle = _handle.get()) {
+                glUnmapNamedBuffer(handle);
+                glDeleteBuffers(1, &handle);
+            }
+        }
+
+        // Value copied by the last frame that used the current region of the allocator, T() if none
+        T read(const FrameAllocator& allocator) const {
+            return _mapping ? _mapping[allocator.frame_index()] : T();
+        }
+
+        // Copy the value at byte offset of the buffer into the slot of the current frame
+        void copy(const FrameAllocator& allocator, const ByteBuffer& buffer, size_t offset = 0) {
+            if(!_mapping) {
+                create();
+            }
+            glCopyNamedBufferSubData(buffer.handle().get(), _handle.get(), offset, allocator.frame_index() * sizeof(T), sizeof(T));
+        }
+
+    private:
+        void create() {
+            constexpr GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            const T zero[FrameAllocator::frames_in_flight] = {};
+            GLuint handle = 0;
+            glCreateBuffers(1, &handle);
+            _handle = GLHandle(handle);
+            glNamedBufferStorage(handle, sizeof(zero), zero, flags);
+            _mapping = static_cast<const T*>(glMapNamedBufferRange(handle, 0, sizeof(zero), flags));
+            ALWAYS_ASSERT(_mapping, "Unable to map readback buffer");
+        }
+
+        GLHandle _handle;
+        const T* _mapping = nullptr;
+};
+
+}
+
+#endif // FRAMEREADBACK_H
@@ -0,0 +1,211 @@
+#include "GeometryArena.h"
+
+#include <StateCache.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+
+namespace OM3D {
+
+static constexpr u32 initial_vertex_capacity = 64 * 1024;
+static constexpr u32 initial_index_capacity = 256 * 1024;
+
+static GLuint create_buffer(size_t byte_size) {
+    GLuint handle = 0;
+    glCreateBuffers(1, &handle);
+    glNamedBufferStorage(handle, byte_size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    return handle;
+}
+
+static void delete_buffer(GLHandle& buffer) {
+    if(auto handle = buffer.get()) {
+        glDeleteBuffers(1, &handle);
+    }
+}
+
+static void delete_vertex_array(GLHandle& vao) {
+    if(auto handle = vao.get()) {
+        forget_vertex_array(handle);
+        glDeleteVertexArrays(1, &handle);
+    }
+}
+
+static GLuint create_vertex_array(VertexStream stream) {
+    GLuint handle = 0;
+    glCreateVertexArrays(1, &handle);
+
+    // Everything is read from binding 0
+    if(stream == VertexStream::Positions) {
+        glVertexArrayAttribFormat(handle, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(handle, 0, 0);
+        glEnableVertexArrayAttrib(handle, 0);
+        return handle;
+    }
+
+    for(u32 i = 0; i != std::size(vertex_attributes); ++i) {
+        glVertexArrayAttribFormat(handle, i, vertex_attributes[i].components, GL_FLOAT, GL_FALSE, vertex_attributes[i].offset);
+        glVertexArrayAttribBinding(handle, i, 0);
+        glEnableVertexArrayAttrib(handle, i);
+    }
+
+    return handle;
+}
+
+static void grow_buffer(GLHandle& buffer, size_t old_byte_size, size_t new_byte_size) {
+    GLHandle new_buffer(create_buffer(new_byte_size));
+    glCopyNamedBufferSubData(buffer.get(), new_buffer.get(), 0, 0, old_byte_size);
+    buffer.swap(new_buffer);
+    delete_buffer(new_buffer);
+}
+
+GeometryArena::RangeAllocator::RangeAllocator(u32 capacity) : _free({{0, capacity}}), _capacity(capacity) {
+}
+
+bool GeometryArena::RangeAllocator::allocate(u32 count, u32& begin) {
+    const auto it = std::find_if(_free.begin(), _free.end(), [=](const Range& range) { return range.count >= count; });
+    if(it == _free.end()) {
+        return false;
+    }
+
+    begin = it->begin;
+    it->begin += count;
+    it->count -= count;
+    if(!it->count) {
+        _free.erase(it);
+    }
+    return true;
+}
+
+void GeometryArena::RangeAllocator::free(u32 begin, u32 count) {
+    if(!count) {
+        return;
+    }
+
+    auto next = std::lower_bound(_free.begin(), _free.end(), begin, [](const Range& range, u32 b) { return range.begin < b; });
+    DEBUG_ASSERT(next == _free.end() || begin + count <= next->begin);
+
+    // Merge with the neighbours
+    const bool merge_prev = next != _free.begin() && std::prev(next)->begin + std::prev(next)->count == begin;
+    const bool merge_next = next != _free.end() && next->begin == begin + count;
+    if(merge_prev && merge_next) {
+        std::prev(next)->count += count + next->count;
+        _free.erase(next);
+    } else if(merge_prev) {
+        std::prev(next)->count += count;
+    } else if(merge_next) {
+        next->begin = begin;
+        next->count += count;
+    } else {
+        _free.insert(next, {begin, count});
+    }
+}
+
+void GeometryArena::RangeAllocator::grow(u32 new_capacity) {
+    DEBUG_ASSERT(new_capacity > _capacity);
+    const u32 old_capacity = _capacity;
+    _capacity = new_capacity;
+    free(old_capacity, new_capacity - old_capacity);
+}
+
+u32 GeometryArena::RangeAllocator::capacity() const {
+    return _capacity;
+}
+
+
+std::shared_ptr<GeometryArena> GeometryArena::arena() {
+    static std::weak_ptr<GeometryArena> global;
+    auto arena = global.lock();
+    if(!arena) {
+        arena = std::shared_ptr<GeometryArena>(new GeometryArena());
+        global = arena;
+    }
+    return arena;
+}
+
+GeometryArena::GeometryArena() :
+        _vao(create_vertex_array(VertexStream::Attributes)),
+        _position_vao(create_vertex_array(VertexStream::Positions)),
+        _vertex_ranges(initial_vertex_capacity),
+        _index_ranges(initial_index_capacity),
+        _vertices(create_buffer(initial_vertex_capacity * sizeof(Vertex))),
+        _positions(create_buffer(initial_vertex_capacity * sizeof(glm::vec3))),
+        _indices(create_buffer(initial_index_capacity * sizeof(u32))) {
+    bind_buffers();
+}
+
+GeometryArena::~GeometryArena() {
+    delete_vertex_array(_vao);
+    delete_vertex_array(_position_vao);
+    delete_buffer(_vertices);
+    delete_buffer(_positions);
+    delete_buffer(_indices);
+}
+
+u32 GeometryArena::allocate_range(RangeAllocator& ranges, Span<const std::pair<GLHandle*, size_t>> buffers, u32 count) {
+    u32 begin = 0;
+    if(!ranges.allocate(count, begin)) {
+        // Copy everything to larger buffers, existing allocations don't move
+        const u32 new_capacity = std::max(ranges.capacity() * 2, ranges.capacity() + count);
+        for(const auto& [buffer, element_size] : buffers) {
+            grow_buffer(*buffer, ranges.capacity() * element_size, new_capacity * element_size);
+        }
+        ranges.grow(new_capacity);
+        bind_buffers();
+
+        const bool allocated = ranges.allocate(count, begin);
+        ALWAYS_ASSERT(allocated, "Geometry arena allocation failed");
+    }
+    return begin;
+}
+
+GeometryAllocation GeometryArena::allocate(Span<const Vertex> vertices, Span<const u32> indices, bool position_stream) {
+    GeometryAllocation alloc;
+    alloc.vertex_count = u32(vertices.size());
+    alloc.index_count = u32(indices.size());
+    if(alloc.vertex_count) {
+        const std::array<std::pair<GLHandle*, size_t>, 2> vertex_buffers = {{{&_vertices, sizeof(Vertex)}, {&_positions, sizeof(glm::vec3)}}};
+        alloc.base_vertex = allocate_range(_vertex_ranges, vertex_buffers, alloc.vertex_count);
+        glNamedBufferSubData(_vertices.get(), alloc.base_vertex * sizeof(Vertex), alloc.vertex_count * sizeof(Vertex), vertices.data());
+
+        if(position_stream) {
+            std::vector<glm::vec3> positions(vertices.size());
+            std::transform(vertices.begin(), vertices.end(), positions.begin(), [](const Vertex& vertex) { return vertex.position; });
+            glNamedBufferSubData(_positions.get(), alloc.base_vertex * sizeof(glm::vec3), alloc.vertex_count * sizeof(glm::vec3), positions.data());
+        }
+    }
+    if(alloc.index_count) {
+        const std::array<std::pair<GLHandle*, size_t>, 1> index_buffers = {{{&_indices, sizeof(u32)}}};
+        alloc.first_index = allocate_range(_index_ranges, index_buffers, alloc.index_count);
+        glNamedBufferSubData(_indices.get(), alloc.first_index * sizeof(u32), alloc.index_count * sizeof(u32), indices.data());
+    }
+    return alloc;
+}
+
+void GeometryArena::free(const GeometryAllocation& alloc) {
+    _vertex_ranges.free(alloc.base_vertex, alloc.vertex_count);
+    _index_ranges.free(alloc.first_index, alloc.index_count);
+}
+
+void GeometryArena::bind(VertexStream stream) const {
+    bind_vertex_array((stream == VertexStream::Positions ? _position_vao : _vao).get());
+}
+
+u32 GeometryArena::vertex_capacity() const {
+    return _vertex_ranges.capacity();
+}
+
+u32 GeometryArena::index_capacity() const {
+    return _index_ranges.capacity();
+}
+
+void GeometryArena::bind_buffers() {
+    glVertexArrayVertexBuffer(_vao.get(), 0, _vertices.get(), 0, sizeof(Vertex));
+    glVertexArrayElementBuffer(_vao.get(), _indices.get());
+
+    glVertexArrayVertexBuffer(_position_vao.get(), 0, _positions.get(), 0, sizeof(glm::vec3));
+    glVertexArrayElementBuffer(_position_vao.get(), _indices.get());
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <graphics.h>
+#include <Vertex.h>
+
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+enum class VertexStream {
+    // Interleaved Vertex, attribute i at location i
+    Attributes,
+    // Tightly packed positions at location 0, for depth only passes
+    Positions,
+};
+
+// Location of a mesh in the arena, indices are relative to base_vertex
+struct GeometryAllocation {
+    u32 base_vertex = 0;
+    u32 vertex_count = 0;
+    u32 first_index = 0;
+    u32 index_count = 0;
+};
+
+// All static geometry lives in one vertex buffer and one index buffer,
+// read through a single vertex array whose format is built from vertex_attributes.
+// A parallel buffer holds a copy of the positions (12 bytes instead of sizeof(Vertex)) with its
+// own vertex array, so that depth only passes fetch less. Both streams share base_vertex.
+// Buffers grow as needed, allocations keep their offsets.
+class GeometryArena : NonMovable {
+    public:
+        // Shared by all meshes, destroyed with the last mesh
+        static std::shared_ptr<GeometryArena> arena();
+
+        ~GeometryArena();
+
+        // Positions are only uploaded with position_stream, the range is reserved either way
+        GeometryAllocation allocate(Span<const Vertex> vertices, Span<const u32> indices, bool position_stream);
+        void free(const GeometryAllocation& alloc);
+
+        void bind(VertexStream stream = VertexStream::Attributes) const;
+
+        u32 vertex_capacity() const;
+        u32 index_capacity() const;
+
+    private:
+        // First fit allocator over [0, capacity), free ranges are sorted and never adjacent
+        class RangeAllocator {
+            public:
+                RangeAllocator(u32 capacity);
+
+                // Returns false if no free range is large enough
+                bool allocate(u32 count, u32& begin);
+                void free(u32 begin, u32 count);
+                void grow(u32 new_capacity);
+
+                u32 capacity() const;
+
+            private:
+                struct Range {
+                    u32 begin;
+                    u32 count;
+                };
+
+                std::vector<Range> _free;
+                u32 _capacity = 0;
+        };
+
+        GeometryArena();
+
+        // Buffers are grown along with the ranges, each with its element size
+        u32 allocate_range(RangeAllocator& ranges, Span<const std::pair<GLHandle*, size_t>> buffers, u32 count);
+        void bind_buffers();
+
+        GLHandle _vao;
+        GLHandle _position_vao;
+
+        RangeAllocator _vertex_ranges;
+        RangeAllocator _index_ranges;
+        GLHandle _vertices;
+        GLHandle _positions;
+        GLHandle _indices;
+};
+
+}
+
+#endif // GEOMETRYARENA_H
@@ -178,17 +178,33 @@ static void mouse_pos_callback(GLFWwindow*, double xpos, double ypos) {
     ImGui::GetIO().AddMousePosEvent(float(xpos), float(ypos));
 }
 
+static GLuint create_vertex_array() {
+    GLuint handle = 0;
+    glCreateVertexArrays(1, &handle);
+
+    glVertexArrayAttribFormat(handle, 0, 2, GL_FLOAT, GL_FALSE, offsetof(ImDrawVert, pos));
+    glVertexArrayAttribFormat(handle, 1, 2, GL_FLOAT, GL_FALSE, offsetof(ImDrawVert, uv));
+    glVertexArrayAttribFormat(handle, 2, 4, GL_UNSIGNED_BYTE, GL_FALSE, offsetof(ImDrawVert, col));
+    for(u32 i = 0; i != 3; ++i) {
+        glVertexArrayAttribBinding(handle, i, 0);
+        glEnableVertexArrayAttrib(handle, i);
+    }
+
+    return handle;
+}
+
 static void mouse_button_callback(GLFWwindow*, int button, int action, int) {
     ImGui::GetIO().AddMouseButtonEvent(button_to_imgui(button), action == GLFW_PRESS);
 }
 
-ImGuiRenderer::ImGuiRenderer(GLFWwindow* window) : _window(window) {
+ImGuiRenderer::ImGuiRenderer(GLFWwindow* window) : _window(window), _vao(create_vertex_array()) {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
 
     _material.set_program(Program::from_files("imgui.frag", "imgui.vert"));
     _material.set_depth_test_mode(DepthTestMode::None);
     _material.set_blend_mode(BlendMode::Alpha);
+    _material.set_cull_mode(CullMode::None);
 
     _font = create_font();
 
@@ -198,6 +214,13 @@ ImGuiRenderer::ImGuiRenderer(GLFWwindow* window) : _window(window) {
     glfwSetMouseButtonCallback(_window, mouse_button_callback);
 }
 
+ImGuiRenderer::~ImGuiRenderer() {
+    if(auto handle = _vao.get()) {
+        forget_vertex_array(handle);
+        glDeleteVertexArrays(1, &handle);
+    }
+}
+
 void ImGuiRenderer::start() {
     auto& io = ImGui::GetIO();
 
@@ -243,7 +266,6 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
 
     glEnable(GL_SCISSOR_TEST);
     DEFER(glDisable(GL_SCISSOR_TEST));
-    glDisable(GL_CULL_FACE);
 
     TypedBuffer<ImDrawIdx> index_buffer(nullptr, draw_data->TotalIdxCount);
     TypedBuffer<ImDrawVert> vertex_buffer(nullptr, draw_data->TotalVtxCount);
@@ -263,14 +285,16 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
         }
     }
 
-    index_buffer.bind(BufferUsage::Index);
-    vertex_buffer.bind(BufferUsage::Attribute);
+    bind_vertex_array(_vao.get());
+    glVertexArrayElementBuffer(_vao.get(), index_buffer.handle().get());
 
-    byte* vertex_offset = nullptr;
+    size_t vertex_offset = 0;
     byte* index_offset = nullptr;
     for(int c = 0; c != draw_data->CmdListsCount; ++c) {
         const ImDrawList* cmd_list = draw_data->CmdLists[c];
 
+        glVertexArrayVertexBuffer(_vao.get(), 0, vertex_buffer.handle().get(), vertex_offset, sizeof(ImDrawVert));
+
         byte* drawn_index_offset = index_offset;
         for(int i = 0; i != cmd_list->CmdBuffer.Size; ++i) {
             const ImDrawCmd& cmd = cmd_list->CmdBuffer[i];
@@ -289,13 +313,6 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
                 tex->bind(0);
             }
 
-            glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(ImDrawVert), vertex_offset);
-            glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(ImDrawVert), vertex_offset + (2 * sizeof(float)));
-            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, false, sizeof(ImDrawVert), vertex_offset + (4 * sizeof(float)));
-            glEnableVertexAttribArray(0);
-            glEnableVertexAttribArray(1);
-            glEnableVertexAttribArray(2);
-
             glDrawElements(GL_TRIANGLES, cmd.ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, reinterpret_cast<void*>(drawn_index_offset));
             drawn_index_offset += cmd.ElemCount * sizeof(ImDrawIdx);
         }
@@ -13,6 +13,7 @@ namespace OM3D {
 class ImGuiRenderer : NonMovable {
     public:
         ImGuiRenderer(GLFWwindow* window);
+        ~ImGuiRenderer();
 
         void start();
         void finish();
@@ -23,6 +24,7 @@ class ImGuiRenderer : NonMovable {
 
         GLFWwindow* _window = nullptr;
 
+        GLHandle _vao;
         Material _material;
         std::unique_ptr<Texture> _font;
         std::chrono::time_point<std::chrono::high_resolution_clock> _last;
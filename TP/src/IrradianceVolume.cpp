@@ -0,0 +1,77 @@
+#include "IrradianceVolume.h"
+
+#include <PointLight.h>
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace OM3D {
+
+static constexpr u32 cube_face_count = 6;
+
+IrradianceVolume IrradianceVolume::bake(Span<const shader::PointLight> lights, const BoundingBox& volume, const glm::uvec3& probe_count) {
+    ALWAYS_ASSERT(probe_count.x && probe_count.y && probe_count.z, "Empty probe grid");
+
+    const glm::vec3 cell_size = (volume.max - volume.min) / glm::vec3(probe_count);
+    const size_t face_texels = size_t(probe_count.x) * probe_count.y * probe_count.z;
+    std::vector<glm::vec4> texels(face_texels * cube_face_count, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    // Each chunk of z slices only visits the probes its lights can reach
+    parallel_for(probe_count.z, 1, [&](size_t begin, size_t end) {
+        for(const shader::PointLight& light : lights) {
+            const glm::vec3 first = glm::floor((light.position - light.radius - volume.min) / cell_size - 0.5f);
+            const glm::vec3 last = glm::ceil((light.position + light.radius - volume.min) / cell_size - 0.5f);
+            const glm::ivec3 probe_min = glm::max(glm::ivec3(first), glm::ivec3(0, 0, int(begin)));
+            const glm::ivec3 probe_max = glm::min(glm::ivec3(last), glm::ivec3(probe_count.x - 1, probe_count.y - 1, int(end) - 1));
+
+            for(int z = probe_min.z; z <= probe_max.z; ++z) {
+                for(int y = probe_min.y; y <= probe_max.y; ++y) {
+                    for(int x = probe_min.x; x <= probe_max.x; ++x) {
+                        const glm::vec3 probe = volume.min + (glm::vec3(x, y, z) + 0.5f) * cell_size;
+                        const glm::vec3 to_light = light.position - probe;
+                        const float dist = glm::length(to_light);
+                        if(dist >= light.radius) {
+                            continue;
+                        }
+
+                        const glm::vec3 light_vec = dist > 0.0f ? to_light / dist : glm::vec3(0.0f);
+                        const glm::vec3 radiance = light.color * (attenuation(dist, light.radius) * light.intensity);
+                        const size_t texel = (size_t(z) * probe_count.y + y) * probe_count.x + x;
+                        for(u32 face = 0; face != cube_face_count; ++face) {
+                            const float NoL = light_vec[face / 2] * (face % 2 ? -1.0f : 1.0f);
+                            if(NoL > 0.0f) {
+                                texels[face * face_texels + texel] += glm::vec4(radiance * NoL, 0.0f);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    IrradianceVolume irradiance;
+    irradiance._volume = volume;
+    irradiance._probe_count = probe_count;
+    irradiance._texture = Texture(glm::uvec3(probe_count.x, probe_count.y, probe_count.z * cube_face_count), ImageFormat::RGBA16_FLOAT, texels.data());
+    return irradiance;
+}
+
+bool IrradianceVolume::is_empty() const {
+    return !_probe_count.x;
+}
+
+const BoundingBox& IrradianceVolume::volume() const {
+    return _volume;
+}
+
+const glm::uvec3& IrradianceVolume::probe_count() const {
+    return _probe_count;
+}
+
+void IrradianceVolume::bind(u32 index) const {
+    _texture.bind(index);
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef IRRADIANCEVOLUME_H
+#define IRRADIANCEVOLUME_H
+
+#include <StaticMesh.h>
+#include <Texture.h>
+#include <shader_structs.h>
+
+namespace OM3D {
+
+// Lighting of static point lights baked in a grid of probes over a volume.
+// Each probe is an ambient cube: the irradiance received by surfaces facing +X, -X, +Y, -Y, +Z and -Z.
+// The faces are stacked along z in a single 3D texture, see irradiance.glsl.
+class IrradianceVolume {
+    public:
+        IrradianceVolume() = default;
+
+        // Evaluate all the lights at the center of each cell of the grid. Multithreaded.
+        static IrradianceVolume bake(Span<const shader::PointLight> lights, const BoundingBox& volume, const glm::uvec3& probe_count);
+
+        bool is_empty() const;
+        const BoundingBox& volume() const;
+        const glm::uvec3& probe_count() const;
+
+        void bind(u32 index) const;
+
+    private:
+        BoundingBox _volume = {};
+        glm::uvec3 _probe_count = {};
+        Texture _texture;
+};
+
+}
+
+#endif // IRRADIANCEVOLUME_H
@@ -16,6 +16,11 @@ namespace OM3D
         _program = std::move(prog);
     }
 
+    void Material::set_forward_program(std::shared_ptr<Program> prog)
+    {
+        _forward_program = std::move(prog);
+    }
+
     void Material::set_blend_mode(BlendMode blend)
     {
         _blend_mode = blend;
@@ -36,95 +41,96 @@ namespace OM3D
         _depth_mask = mask;
     }
 
-    void Material::set_texture(u32 slot, std::shared_ptr<Texture> tex)
+    void Material::set_texture(u32 slot, std::shared_ptr<Texture> tex, u32 layer)
     {
         if (const auto it = std::find_if(_textures.begin(), _textures.end(), [&](const auto &t)
-                                         { return t.second == tex; });
+                                         { return t.first == slot; });
             it != _textures.end())
         {
             it->second = std::move(tex);
+            _texture_layers[it - _textures.begin()] = layer;
         }
         else
         {
             _textures.emplace_back(slot, std::move(tex));
+            _texture_layers.push_back(layer);
         }
     }
 
-    bool Material::is_transparent()
+    void Material::set_base_color_factor(const glm::vec4 &factor)
     {
-        return _blend_mode != BlendMode::None;
+        _base_color_factor = factor;
     }
 
-    void Material::bind(CullMode force_cullmode) const
+    u32 Material::texture_layer(u32 slot) const
     {
-        switch (_blend_mode)
+        for (size_t i = 0; i != _textures.size(); ++i)
         {
-        case BlendMode::None:
-            glDisable(GL_BLEND);
-            break;
-
-        case BlendMode::Alpha:
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            break;
-
-        case BlendMode::Additive:
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE);
-            break;
+            if (_textures[i].first == slot)
+                return _texture_layers[i];
         }
+        return 0;
+    }
 
-        switch (_depth_test_mode)
-        {
-        case DepthTestMode::None:
-            glDisable(GL_DEPTH_TEST);
-            break;
-
-        case DepthTestMode::Equal:
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(GL_EQUAL);
-            break;
-
-        case DepthTestMode::Standard:
-            glEnable(GL_DEPTH_TEST);
-            // We are using reverse-Z
-            glDepthFunc(GL_GEQUAL);
-            break;
-
-        case DepthTestMode::Reversed:
-            glEnable(GL_DEPTH_TEST);
-            // We are using reverse-Z
-            glDepthFunc(GL_LEQUAL);
-            break;
-        }
+    const glm::vec4 &Material::base_color_factor() const
+    {
+        return _base_color_factor;
+    }
 
-        glDepthMask(_depth_mask);
+    BlendMode Material::blend_mode() const
+    {
+        return _blend_mode;
+    }
 
-        CullMode cull_to_apply = _culling_mode;
-        if (force_cullmode != CullMode::None)
-        {
-            cull_to_apply = force_cullmode;
-        }
-        switch (cull_to_apply)
-        {
-        case CullMode::None:
-            glDisable(GL_CULL_FACE);
-            break;
-        case CullMode::Backface:
-            glCullFace(GL_BACK);
-            glEnable(GL_CULL_FACE);
-            break;
-        case CullMode::Frontface:
-            glCullFace(GL_FRONT);
-            glEnable(GL_CULL_FACE);
-            break;
-        }
+    CullMode Material::cull_mode() const
+    {
+        return _culling_mode;
+    }
+
+    DepthTestMode Material::depth_test_mode() const
+    {
+        return _depth_test_mode;
+    }
+
+    bool Material::depth_mask() const
+    {
+        return _depth_mask;
+    }
+
+    bool Material::is_transparent() const
+    {
+        return _blend_mode != BlendMode::None;
+    }
+
+    const std::shared_ptr<Program> &Material::program() const
+    {
+        return _program;
+    }
+
+    const std::shared_ptr<Program> &Material::forward_program() const
+    {
+        return _forward_program;
+    }
+
+    Span<const std::pair<u32, std::shared_ptr<Texture>>> Material::textures() const
+    {
+        return _textures;
+    }
+
+    void Material::bind(CullMode force_cullmode, bool forward) const
+    {
+        ALWAYS_ASSERT(!forward || _forward_program, "Material has no forward program");
+
+        bind_blend_mode(_blend_mode);
+        bind_depth_test_mode(_depth_test_mode);
+        bind_depth_mask(_depth_mask);
+        bind_cull_mode(force_cullmode != CullMode::None ? force_cullmode : _culling_mode);
 
         for (const auto &texture : _textures)
         {
             texture.second->bind(texture.first);
         }
-        _program->bind();
+        (forward ? _forward_program : _program)->bind();
     }
 
     std::shared_ptr<Material> Material::empty_material()
@@ -135,6 +141,21 @@ namespace OM3D
         {
             material = std::make_shared<Material>();
             material->_program = Program::from_files("g_buffer.frag", "basic.vert");
+            material->_forward_program = Program::from_files("lit.frag", "basic.vert");
+            weak_material = material;
+        }
+        return material;
+    }
+
+    std::shared_ptr<Material> Material::depth_only_material()
+    {
+        static std::weak_ptr<Material> weak_material;
+        auto material = weak_material.lock();
+        if (!material)
+        {
+            material = std::make_shared<Material>();
+            material->_program = Program::from_files("depth_only.frag", "depth_only.vert");
+            material->_culling_mode = CullMode::None;
             weak_material = material;
         }
         return material;
@@ -144,6 +165,7 @@ namespace OM3D
     {
         Material material;
         material._program = Program::from_files("g_buffer.frag", "basic.vert", {"TEXTURED"});
+        material._forward_program = Program::from_files("lit.frag", "basic.vert", {"TEXTURED"});
         return material;
     }
 
@@ -151,6 +173,7 @@ namespace OM3D
     {
         Material material;
         material._program = Program::from_files("g_buffer.frag", "basic.vert", std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
+        material._forward_program = Program::from_files("lit.frag", "basic.vert", std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
         return material;
     }
 
@@ -162,8 +185,10 @@ namespace OM3D
         copy->set_depth_mask(_depth_mask);
         copy->set_depth_test_mode(_depth_test_mode);
         copy->set_program(_program);
-        for (auto tex : _textures)
-            copy->set_texture(tex.first, tex.second);
+        copy->set_forward_program(_forward_program);
+        copy->set_base_color_factor(_base_color_factor);
+        for (size_t i = 0; i != _textures.size(); ++i)
+            copy->set_texture(_textures[i].first, _textures[i].second, _texture_layers[i]);
 
         return copy;
     }
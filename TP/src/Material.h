@@ -5,31 +5,13 @@
 
 #include <Program.h>
 #include <Texture.h>
+#include <StateCache.h>
 
 #include <memory>
 #include <vector>
 
 namespace OM3D {
 
-enum class BlendMode {
-    None,
-    Alpha,
-    Additive,
-};
-
-enum class CullMode {
-    None, 
-    Backface,
-    Frontface,
-};
-
-enum class DepthTestMode {
-    Standard,
-    Reversed,
-    Equal,
-    None
-};
-
 class Material {
 
     public:
@@ -37,12 +19,27 @@ class Material {
         std::shared_ptr<Material> copy_material();
 
         void set_program(std::shared_ptr<Program> prog);
+        // Program of the Forward+ pass (lit.frag), for the materials that support it
+        void set_forward_program(std::shared_ptr<Program> prog);
         void set_blend_mode(BlendMode blend);
         void set_cull_mode(CullMode cull);
         void set_depth_test_mode(DepthTestMode depth);
         void set_depth_mask(GLboolean mask);
-        void set_texture(u32 slot, std::shared_ptr<Texture> tex);
-        bool is_transparent();
+        // Layer is used by the texture array shaders, through the scene material table
+        void set_texture(u32 slot, std::shared_ptr<Texture> tex, u32 layer = 0);
+        void set_base_color_factor(const glm::vec4& factor);
+        bool is_transparent() const;
+
+        const std::shared_ptr<Program>& program() const;
+        const std::shared_ptr<Program>& forward_program() const;
+        Span<const std::pair<u32, std::shared_ptr<Texture>>> textures() const;
+        u32 texture_layer(u32 slot) const;
+        const glm::vec4& base_color_factor() const;
+
+        BlendMode blend_mode() const;
+        CullMode cull_mode() const;
+        DepthTestMode depth_test_mode() const;
+        bool depth_mask() const;
 
         template<typename... Args>
         void set_uniform(Args&&... args) {
@@ -50,16 +47,23 @@ class Material {
         }
 
 
-        void bind(CullMode force_cullmode = CullMode::None) const;
+        // With forward, binds the forward program instead
+        void bind(CullMode force_cullmode = CullMode::None, bool forward = false) const;
 
         static std::shared_ptr<Material> empty_material();
+        // Writes depth only, for pre-passes. Draws override its culling with the one of their material.
+        static std::shared_ptr<Material> depth_only_material();
         static Material textured_material();
         static Material textured_normal_mapped_material();
 
 
     private:
         std::shared_ptr<Program> _program;
+        std::shared_ptr<Program> _forward_program;
         std::vector<std::pair<u32, std::shared_ptr<Texture>>> _textures;
+        // Parallel to _textures
+        std::vector<u32> _texture_layers;
+        glm::vec4 _base_color_factor = glm::vec4(1.0f);
 
         BlendMode _blend_mode = BlendMode::None;
         DepthTestMode _depth_test_mode = DepthTestMode::Standard;
@@ -0,0 +1,268 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OM3D_OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+namespace OM3D {
+
+OcclusionCuller::OcclusionCuller() : _depth(width * height, 0.0f) {
+}
+
+void OcclusionCuller::clear(const glm::mat4& view_proj) {
+    // We use reverse-Z so far is 0
+    std::fill(_depth.begin(), _depth.end(), 0.0f);
+    _view_proj = view_proj;
+    _occluder_count = 0;
+    _tested_count = 0;
+    _occluded_count = 0;
+}
+
+void OcclusionCuller::add_occluder(Span<const glm::vec3> positions, Span<const u32> indices, const glm::mat4& transform) {
+    if(indices.is_empty()) {
+        return;
+    }
+
+    const glm::mat4 model_view_proj = _view_proj * transform;
+
+    std::vector<glm::vec4> clip(positions.size());
+    for(size_t i = 0; i != positions.size(); ++i) {
+        clip[i] = model_view_proj * glm::vec4(positions[i], 1.0f);
+    }
+
+    for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+        rasterize_triangle(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+    }
+
+    ++_occluder_count;
+}
+
+// Distance to the reverse-Z near plane (ndc z <= 1), positive when in front of the camera
+static float near_distance(const glm::vec4& v) {
+    return v.w - v.z;
+}
+
+static glm::vec3 to_screen(const glm::vec4& clip) {
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    return glm::vec3(
+        (ndc.x * 0.5f + 0.5f) * float(OcclusionCuller::width),
+        (ndc.y * 0.5f + 0.5f) * float(OcclusionCuller::height),
+        ndc.z
+    );
+}
+
+void OcclusionCuller::rasterize_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    // Trivial rejection against the side planes
+    for(int axis = 0; axis != 2; ++axis) {
+        if(a[axis] > a.w && b[axis] > b.w && c[axis] > c.w) {
+            return;
+        }
+        if(a[axis] < -a.w && b[axis] < -b.w && c[axis] < -c.w) {
+            return;
+        }
+    }
+
+    const glm::vec4 in[] = {a, b, c};
+    const float dist[] = {near_distance(a), near_distance(b), near_distance(c)};
+
+    if(dist[0] > 0.0f && dist[1] > 0.0f && dist[2] > 0.0f) {
+        rasterize_clipped_triangle(to_screen(a), to_screen(b), to_screen(c));
+        return;
+    }
+
+    // Clip against the near plane, this produces at most 4 vertices
+    glm::vec4 clipped[4];
+    u32 count = 0;
+    for(u32 i = 0; i != 3; ++i) {
+        const u32 next = (i + 1) % 3;
+        if(dist[i] > 0.0f) {
+            clipped[count++] = in[i];
+        }
+        if((dist[i] > 0.0f) != (dist[next] > 0.0f)) {
+            const float t = dist[i] / (dist[i] - dist[next]);
+            clipped[count++] = in[i] + (in[next] - in[i]) * t;
+        }
+    }
+
+    for(u32 i = 2; i < count; ++i) {
+        rasterize_clipped_triangle(to_screen(clipped[0]), to_screen(clipped[i - 1]), to_screen(clipped[i]));
+    }
+}
+
+void OcclusionCuller::rasterize_clipped_triangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if(!(std::abs(area) > 0.0f)) {
+        return;
+    }
+    if(area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    const float fmin_x = std::max(std::min({v0.x, v1.x, v2.x}), 0.0f);
+    const float fmin_y = std::max(std::min({v0.y, v1.y, v2.y}), 0.0f);
+    const float fmax_x = std::min(std::max({v0.x, v1.x, v2.x}), float(width - 1));
+    const float fmax_y = std::min(std::max({v0.y, v1.y, v2.y}), float(height - 1));
+    if(fmin_x > fmax_x || fmin_y > fmax_y) {
+        return;
+    }
+
+    // Start on a multiple of 4 so each row is processed in SIMD lanes, width is a multiple of 4
+    const int min_x = int(fmin_x) & ~3;
+    const int min_y = int(fmin_y);
+    const int max_x = int(fmax_x);
+    const int max_y = int(fmax_y);
+
+    // Edge functions e(p) = cross(b - a, p - a), positive inside a counter clockwise triangle
+    const glm::vec3 verts[] = {v0, v1, v2};
+    float edge_dx[3];
+    float edge_dy[3];
+    float edge_origin[3];
+    for(int i = 0; i != 3; ++i) {
+        const glm::vec3& ea = verts[i];
+        const glm::vec3& eb = verts[(i + 1) % 3];
+        edge_dx[i] = ea.y - eb.y;
+        edge_dy[i] = eb.x - ea.x;
+        const float px = float(min_x) + 0.5f - ea.x;
+        const float py = float(min_y) + 0.5f - ea.y;
+        edge_origin[i] = edge_dy[i] * py + edge_dx[i] * px;
+    }
+
+    // Depth is affine in screen space
+    const float inv_area = 1.0f / area;
+    const float z_dx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) * inv_area;
+    const float z_dy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) * inv_area;
+    const float z_origin = v0.z + z_dx * (float(min_x) + 0.5f - v0.x) + z_dy * (float(min_y) + 0.5f - v0.y);
+
+#ifdef OM3D_OCCLUSION_SSE
+    const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 step_z = _mm_mul_ps(lanes, _mm_set1_ps(z_dx));
+    __m128 step_e[3];
+    for(int i = 0; i != 3; ++i) {
+        step_e[i] = _mm_mul_ps(lanes, _mm_set1_ps(edge_dx[i]));
+    }
+#endif
+
+    for(int y = min_y; y <= max_y; ++y) {
+        const float row = float(y - min_y);
+        float* depth_row = _depth.data() + size_t(y) * width;
+
+        for(int x = min_x; x <= max_x; x += 4) {
+            const float col = float(x - min_x);
+            const float e0 = edge_origin[0] + edge_dy[0] * row + edge_dx[0] * col;
+            const float e1 = edge_origin[1] + edge_dy[1] * row + edge_dx[1] * col;
+            const float e2 = edge_origin[2] + edge_dy[2] * row + edge_dx[2] * col;
+            const float z = z_origin + z_dy * row + z_dx * col;
+
+#ifdef OM3D_OCCLUSION_SSE
+            const __m128 inside = _mm_and_ps(
+                _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e0), step_e[0]), zero),
+                _mm_and_ps(
+                    _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e1), step_e[1]), zero),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(e2), step_e[2]), zero)));
+            if(!_mm_movemask_ps(inside)) {
+                continue;
+            }
+
+            const __m128 depth = _mm_add_ps(_mm_set1_ps(z), step_z);
+            const __m128 previous = _mm_loadu_ps(depth_row + x);
+            const __m128 nearest = _mm_max_ps(previous, depth);
+            _mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+#else
+            for(int lane = 0; lane != 4; ++lane) {
+                const float l = float(lane);
+                if(e0 + edge_dx[0] * l >= 0.0f && e1 + edge_dx[1] * l >= 0.0f && e2 + edge_dx[2] * l >= 0.0f) {
+                    float& d = depth_row[x + lane];
+                    d = std::max(d, z + z_dx * l);
+                }
+            }
+#endif
+        }
+    }
+}
+
+bool OcclusionCuller::is_occluded(const BoundingBox& box) {
+    ++_tested_count;
+    if(!_occluder_count) {
+        return false;
+    }
+
+    glm::vec2 screen_min = glm::vec2(float(width), float(height));
+    glm::vec2 screen_max = glm::vec2(0.0f);
+    float nearest = 0.0f;
+    for(u32 i = 0; i != 8; ++i) {
+        const glm::vec3 corner(
+            (i & 1) ? box.max.x : box.min.x,
+            (i & 2) ? box.max.y : box.min.y,
+            (i & 4) ? box.max.z : box.min.z
+        );
+        const glm::vec4 clip = _view_proj * glm::vec4(corner, 1.0f);
+        if(clip.w <= 0.0f || near_distance(clip) <= 0.0f) {
+            // Crosses the near plane, can't be occluded
+            return false;
+        }
+
+        const glm::vec3 screen = to_screen(clip);
+        screen_min = glm::min(screen_min, glm::vec2(screen));
+        screen_max = glm::max(screen_max, glm::vec2(screen));
+        nearest = std::max(nearest, screen.z);
+    }
+
+    if(screen_max.x < 0.0f || screen_max.y < 0.0f || screen_min.x >= float(width) || screen_min.y >= float(height)) {
+        // Off screen: left to frustum culling
+        return false;
+    }
+
+    const int min_x = int(std::max(screen_min.x, 0.0f));
+    const int min_y = int(std::max(screen_min.y, 0.0f));
+    const int max_x = int(std::min(screen_max.x, float(width - 1)));
+    const int max_y = int(std::min(screen_max.y, float(height - 1)));
+
+#ifdef OM3D_OCCLUSION_SSE
+    const __m128 box_depth = _mm_set1_ps(nearest);
+#endif
+
+    for(int y = min_y; y <= max_y; ++y) {
+        const float* depth_row = _depth.data() + size_t(y) * width;
+        int x = min_x;
+#ifdef OM3D_OCCLUSION_SSE
+        for(; x + 3 <= max_x; x += 4) {
+            // Visible if any occluder depth is not strictly in front of the box
+            if(_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(depth_row + x), box_depth))) {
+                return false;
+            }
+        }
+#endif
+        for(; x <= max_x; ++x) {
+            if(depth_row[x] <= nearest) {
+                return false;
+            }
+        }
+    }
+
+    ++_occluded_count;
+    return true;
+}
+
+Span<const float> OcclusionCuller::depth_buffer() const {
+    return _depth;
+}
+
+u32 OcclusionCuller::occluder_count() const {
+    return _occluder_count;
+}
+
+u32 OcclusionCuller::tested_count() const {
+    return _tested_count;
+}
+
+u32 OcclusionCuller::occluded_count() const {
+    return _occluded_count;
+}
+
+}
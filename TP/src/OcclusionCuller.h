@@ -0,0 +1,56 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <StaticMesh.h>
+
+#include <glm/matrix.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// Software occlusion culling: a small set of occluders is rasterized on the CPU
+// into a low resolution reverse-Z depth buffer, then object bounding boxes are
+// tested against it. Does not touch the GPU and is fully deterministic.
+class OcclusionCuller : NonCopyable {
+    public:
+        static constexpr u32 width = 256;
+        static constexpr u32 height = 128;
+
+        OcclusionCuller();
+
+        // Clear the depth buffer and set the projection used for the frame
+        void clear(const glm::mat4& view_proj);
+
+        // Rasterize an indexed triangle list transformed by `transform`
+        void add_occluder(Span<const glm::vec3> positions, Span<const u32> indices, const glm::mat4& transform);
+
+        // Returns true when the box is completely hidden behind the rasterized occluders
+        bool is_occluded(const BoundingBox& box);
+
+        Span<const float> depth_buffer() const;
+
+        u32 occluder_count() const;
+        u32 tested_count() const;
+        u32 occluded_count() const;
+
+        // Maximum number of occluders rasterized per frame
+        u32 max_occluders = 32;
+        // Minimum projected size (bounding box diagonal over distance) to be selected as an occluder
+        float min_occluder_size = 0.2f;
+
+    private:
+        void rasterize_triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        void rasterize_clipped_triangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2);
+
+        std::vector<float> _depth;
+        glm::mat4 _view_proj = glm::mat4(1.0f);
+
+        u32 _occluder_count = 0;
+        u32 _tested_count = 0;
+        u32 _occluded_count = 0;
+};
+
+}
+
+#endif // OCCLUSIONCULLER_H
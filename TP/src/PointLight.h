@@ -5,8 +5,18 @@
 
 #include <glm/vec3.hpp>
 
+#include <algorithm>
+
 namespace OM3D {
 
+// Falloff of a point light of the given radius, must stay the same as attenuation() in utils.glsl
+inline float attenuation(float distance, float radius) {
+    const float x = std::min(distance, radius);
+    const float t = x / radius;
+    const float window = 1.0f - (t * t) * (t * t);
+    return (window * window) / (x * x + 1.0f);
+}
+
 class PointLight : NonCopyable {
 
     public:
@@ -29,6 +39,11 @@ class PointLight : NonCopyable {
             _intensity = intensity;
         }
 
+        // Static lights never change once the scene lights are baked, see Scene::bake_static_lights
+        void set_static(bool is_static) {
+            _is_static = is_static;
+        }
+
 
         const glm::vec3& position() const {
             return _position;
@@ -46,11 +61,16 @@ class PointLight : NonCopyable {
             return _intensity;
         }
 
+        bool is_static() const {
+            return _is_static;
+        }
+
     private:
         glm::vec3 _position = {};
         glm::vec3 _color = glm::vec3(1.0f);
         float _radius = 10.0f;
         float _intensity = 1.0f;
+        bool _is_static = false;
 };
 
 }
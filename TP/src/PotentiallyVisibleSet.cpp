@@ -0,0 +1,312 @@
+#include "PotentiallyVisibleSet.h"
+
+#include <OcclusionCuller.h>
+
+#include <glm/vector_relational.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace OM3D {
+
+// Occluders rasterized per cube face, picked by projected size
+static constexpr size_t max_face_occluders = 64;
+
+static std::vector<u32> compress(const std::vector<u32>& words) {
+    std::vector<u32> compressed;
+    size_t i = 0;
+    while(i < words.size()) {
+        const size_t zeros_begin = i;
+        while(i < words.size() && !words[i]) {
+            ++i;
+        }
+        const size_t literals_begin = i;
+        while(i < words.size() && words[i]) {
+            ++i;
+        }
+        compressed.push_back(u32(literals_begin - zeros_begin));
+        compressed.push_back(u32(i - literals_begin));
+        compressed.insert(compressed.end(), words.begin() + literals_begin, words.begin() + i);
+    }
+    return compressed;
+}
+
+static glm::mat4 face_projection() {
+    // 90 degree vertical fov, the 2:1 occlusion buffer covers more than 90 degrees horizontally.
+    // Same infinite reverse-Z projection as the camera.
+    const float aspect = float(OcclusionCuller::width) / float(OcclusionCuller::height);
+    const float z_near = 0.01f;
+    return glm::mat4(1.0f / aspect, 0.0f,  0.0f,  0.0f,
+                     0.0f,          1.0f,  0.0f,  0.0f,
+                     0.0f,          0.0f,  0.0f, -1.0f,
+                     0.0f,          0.0f, z_near, 0.0f);
+}
+
+static bool is_outside_frustum(const glm::mat4& view_proj, const BoundingBox& box) {
+    glm::vec4 corners[8];
+    for(u32 i = 0; i != 8; ++i) {
+        const glm::vec3 corner(
+            (i & 1) ? box.max.x : box.min.x,
+            (i & 2) ? box.max.y : box.min.y,
+            (i & 4) ? box.max.z : box.min.z
+        );
+        corners[i] = view_proj * glm::vec4(corner, 1.0f);
+    }
+
+    auto all_outside = [&](auto&& outside) {
+        return std::all_of(std::begin(corners), std::end(corners), outside);
+    };
+
+    return all_outside([](const glm::vec4& c) { return c.x > c.w; })
+        || all_outside([](const glm::vec4& c) { return c.x < -c.w; })
+        || all_outside([](const glm::vec4& c) { return c.y > c.w; })
+        || all_outside([](const glm::vec4& c) { return c.y < -c.w; })
+        || all_outside([](const glm::vec4& c) { return c.z > c.w; });
+}
+
+static bool intersects(const BoundingBox& a, const BoundingBox& b) {
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+static bool is_occluder(const PotentiallyVisibleSet::Object& object) {
+    return !object.occluder_indices.is_empty();
+}
+
+// Parity of the crossings of the ray with the occluder triangles, two sided
+static bool crosses_odd(const PotentiallyVisibleSet::Object& object, const glm::vec3& origin, const glm::vec3& dir) {
+    const Span<const glm::vec3> positions = object.occluder_positions;
+    const Span<const u32> indices = object.occluder_indices;
+
+    bool odd = false;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3 a = glm::vec3(object.transform * glm::vec4(positions[indices[i]], 1.0f));
+        const glm::vec3 b = glm::vec3(object.transform * glm::vec4(positions[indices[i + 1]], 1.0f));
+        const glm::vec3 c = glm::vec3(object.transform * glm::vec4(positions[indices[i + 2]], 1.0f));
+
+        // Moller-Trumbore
+        const glm::vec3 ab = b - a;
+        const glm::vec3 ac = c - a;
+        const glm::vec3 p = glm::cross(dir, ac);
+        const float det = glm::dot(ab, p);
+        if(std::abs(det) < 1e-12f) {
+            continue;
+        }
+        const glm::vec3 to_origin = origin - a;
+        const float u = glm::dot(to_origin, p) / det;
+        const glm::vec3 q = glm::cross(to_origin, ab);
+        const float v = glm::dot(dir, q) / det;
+        const float t = glm::dot(ac, q) / det;
+        if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f) {
+            odd = !odd;
+        }
+    }
+    return odd;
+}
+
+// Inside the closed surface of the occluder, the majority of three rays must agree to tolerate cracks and grazing rays
+static bool is_inside_occluder(const PotentiallyVisibleSet::Object& object, const glm::vec3& pos) {
+    if(!is_occluder(object) || glm::any(glm::lessThanEqual(pos, object.bounds.min)) || glm::any(glm::greaterThanEqual(pos, object.bounds.max))) {
+        return false;
+    }
+
+    static const glm::vec3 directions[] = {
+        glm::normalize(glm::vec3(1.0f, 0.13f, 0.07f)),
+        glm::normalize(glm::vec3(-0.11f, 1.0f, 0.17f)),
+        glm::normalize(glm::vec3(0.05f, -0.19f, 1.0f)),
+    };
+    u32 inside = 0;
+    for(const glm::vec3& dir : directions) {
+        inside += crosses_odd(object, pos, dir) ? 1 : 0;
+    }
+    return inside >= 2;
+}
+
+static bool is_inside_any_occluder(Span<const PotentiallyVisibleSet::Object> objects, const glm::vec3& pos) {
+    return std::any_of(objects.begin(), objects.end(), [&](const PotentiallyVisibleSet::Object& object) { return is_inside_occluder(object, pos); });
+}
+
+static std::vector<u32> bake_cell(Span<const PotentiallyVisibleSet::Object> objects, const BoundingBox& cell, u32 samples_per_axis, OcclusionCuller& culler) {
+    std::vector<u32> bits((objects.size() + 31) / 32, 0);
+    auto set_visible = [&](size_t index) {
+        bits[index / 32] |= 1u << (index % 32);
+    };
+
+    // The camera can be inside anything overlapping the cell
+    for(size_t i = 0; i != objects.size(); ++i) {
+        if(intersects(objects[i].bounds, cell)) {
+            set_visible(i);
+        }
+    }
+
+    static const std::pair<glm::vec3, glm::vec3> faces[] = {
+        {glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        {glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        {glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f, 0.0f, 1.0f)},
+        {glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f, 0.0f, 1.0f)},
+        {glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        {glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+    };
+
+    // Sample positions tried in turn in the part of the cell of a sample, in fractions of that part
+    static const glm::vec3 jitters[] = {
+        glm::vec3(0.0f),
+        glm::vec3(-0.375f, -0.375f, -0.375f), glm::vec3(0.375f, -0.375f, -0.375f),
+        glm::vec3(-0.375f, 0.375f, -0.375f), glm::vec3(0.375f, 0.375f, -0.375f),
+        glm::vec3(-0.375f, -0.375f, 0.375f), glm::vec3(0.375f, -0.375f, 0.375f),
+        glm::vec3(-0.375f, 0.375f, 0.375f), glm::vec3(0.375f, 0.375f, 0.375f),
+    };
+
+    const glm::mat4 projection = face_projection();
+    const glm::vec3 sample_extent = (cell.max - cell.min) / float(samples_per_axis);
+    std::vector<std::pair<float, size_t>> candidates;
+    u32 sample_count = 0;
+
+    for(u32 s = 0; s != samples_per_axis * samples_per_axis * samples_per_axis; ++s) {
+        const glm::vec3 grid_pos = glm::vec3(
+            float(s % samples_per_axis),
+            float((s / samples_per_axis) % samples_per_axis),
+            float(s / (samples_per_axis * samples_per_axis))
+        );
+        const glm::vec3 center = cell.min + sample_extent * (grid_pos + 0.5f);
+
+        // A sample inside an occluder only sees its inside, which would hide everything around
+        const glm::vec3* jitter = std::find_if(std::begin(jitters), std::end(jitters), [&](const glm::vec3& offset) {
+            return !is_inside_any_occluder(objects, center + sample_extent * offset);
+        });
+        if(jitter == std::end(jitters)) {
+            continue;
+        }
+        const glm::vec3 sample = center + sample_extent * *jitter;
+        ++sample_count;
+
+        for(const auto& [dir, up] : faces) {
+            const glm::mat4 view_proj = projection * glm::lookAt(sample, sample + dir, up);
+            culler.clear(view_proj);
+
+            candidates.clear();
+            for(size_t i = 0; i != objects.size(); ++i) {
+                if(is_occluder(objects[i]) && !is_outside_frustum(view_proj, objects[i].bounds)) {
+                    const float dist = std::max(glm::distance(objects[i].bounds.center(), sample), 1e-3f);
+                    candidates.emplace_back(glm::length(objects[i].bounds.extent()) / dist, i);
+                }
+            }
+
+            const size_t occluder_count = std::min(candidates.size(), max_face_occluders);
+            std::partial_sort(candidates.begin(), candidates.begin() + occluder_count, candidates.end(), [](const auto& a, const auto& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+            for(size_t i = 0; i != occluder_count; ++i) {
+                const PotentiallyVisibleSet::Object& occluder = objects[candidates[i].second];
+                culler.add_occluder(occluder.occluder_positions, occluder.occluder_indices, occluder.transform);
+            }
+
+            for(size_t i = 0; i != objects.size(); ++i) {
+                if(PotentiallyVisibleSet::is_set(bits, i) || is_outside_frustum(view_proj, objects[i].bounds)) {
+                    continue;
+                }
+                if(!culler.is_occluded(objects[i].bounds)) {
+                    set_visible(i);
+                }
+            }
+        }
+    }
+
+    // Entirely inside occluders, the camera should not be there: nothing can be culled safely
+    if(!sample_count) {
+        for(size_t i = 0; i != objects.size(); ++i) {
+            set_visible(i);
+        }
+    }
+
+    return bits;
+}
+
+PotentiallyVisibleSet PotentiallyVisibleSet::bake(Span<const Object> objects, const BoundingBox& volume, const glm::uvec3& cell_count, u32 samples_per_axis) {
+    const double time = program_time();
+
+    PotentiallyVisibleSet pvs;
+    pvs._volume = volume;
+    pvs._cell_count = glm::max(cell_count, glm::uvec3(1));
+    pvs._object_count = objects.size();
+    pvs._cells.resize(pvs.cell_count());
+
+    samples_per_axis = std::max(samples_per_axis, 1u);
+
+    // Cells are independent, results don't depend on the thread count
+    std::atomic<u32> next_cell = 0;
+    auto bake_cells = [&] {
+        OcclusionCuller culler;
+        for(u32 cell = next_cell++; cell < pvs.cell_count(); cell = next_cell++) {
+            pvs._cells[cell] = compress(bake_cell(objects, pvs.cell_bounds(cell), samples_per_axis, culler));
+        }
+    };
+
+    std::vector<std::thread> threads(std::max(std::thread::hardware_concurrency(), 1u));
+    for(std::thread& thread : threads) {
+        thread = std::thread(bake_cells);
+    }
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::cout << "PVS baked (" << pvs.cell_count() << " cells, " << pvs.compressed_byte_size() << " bytes) in " << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl;
+
+    return pvs;
+}
+
+bool PotentiallyVisibleSet::is_empty() const {
+    return _cells.empty();
+}
+
+int PotentiallyVisibleSet::cell_index(const glm::vec3& pos) const {
+    if(is_empty()) {
+        return -1;
+    }
+
+    const glm::vec3 cell_size = (_volume.max - _volume.min) / glm::vec3(_cell_count);
+    const glm::vec3 cell = glm::floor((pos - _volume.min) / cell_size);
+    if(glm::any(glm::lessThan(cell, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(cell, glm::vec3(_cell_count)))) {
+        return -1;
+    }
+
+    const glm::uvec3 c = glm::uvec3(cell);
+    return int((c.z * _cell_count.y + c.y) * _cell_count.x + c.x);
+}
+
+BoundingBox PotentiallyVisibleSet::cell_bounds(u32 index) const {
+    const glm::uvec3 c(index % _cell_count.x, (index / _cell_count.x) % _cell_count.y, index / (_cell_count.x * _cell_count.y));
+    const glm::vec3 cell_size = (_volume.max - _volume.min) / glm::vec3(_cell_count);
+    const glm::vec3 min = _volume.min + glm::vec3(c) * cell_size;
+    return {min, min + cell_size};
+}
+
+u32 PotentiallyVisibleSet::cell_count() const {
+    return _cell_count.x * _cell_count.y * _cell_count.z;
+}
+
+void PotentiallyVisibleSet::decompress_cell(u32 index, std::vector<u32>& bits) const {
+    bits.assign((_object_count + 31) / 32, 0);
+
+    const std::vector<u32>& compressed = _cells[index];
+    size_t word = 0;
+    for(size_t i = 0; i + 1 < compressed.size();) {
+        word += compressed[i];
+        const u32 literals = compressed[i + 1];
+        std::copy_n(compressed.begin() + i + 2, literals, bits.begin() + word);
+        word += literals;
+        i += 2 + literals;
+    }
+}
+
+size_t PotentiallyVisibleSet::compressed_byte_size() const {
+    size_t size = 0;
+    for(const std::vector<u32>& cell : _cells) {
+        size += cell.size() * sizeof(u32);
+    }
+    return size;
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef POTENTIALLYVISIBLESET_H
+#define POTENTIALLYVISIBLESET_H
+
+#include <StaticMesh.h>
+
+#include <vector>
+
+namespace OM3D {
+
+// Precomputed visibility for static scenes: the view volume is divided in a grid
+// of cells, each storing a compressed bitset of the objects visible from inside it.
+class PotentiallyVisibleSet {
+    public:
+        struct Object {
+            BoundingBox bounds;
+            // Indexed triangles rasterized as occluder, empty if the object should never occlude anything
+            Span<const glm::vec3> occluder_positions;
+            Span<const u32> occluder_indices;
+            glm::mat4 transform = glm::mat4(1.0f);
+        };
+
+        PotentiallyVisibleSet() = default;
+
+        // Sample visibility from a grid of points in each cell by rasterizing the
+        // surrounding occluders into cube maps (see OcclusionCuller). Multithreaded.
+        // Samples inside an occluder are moved within their part of the cell, or skipped if they can't be.
+        // A cell without any usable sample sees everything.
+        static PotentiallyVisibleSet bake(Span<const Object> objects, const BoundingBox& volume, const glm::uvec3& cell_count, u32 samples_per_axis = 2);
+
+        bool is_empty() const;
+
+        // Returns -1 if the position is outside of the baked volume
+        int cell_index(const glm::vec3& pos) const;
+        BoundingBox cell_bounds(u32 index) const;
+        u32 cell_count() const;
+
+        // Expand the visibility of a cell into one bit per object
+        void decompress_cell(u32 index, std::vector<u32>& bits) const;
+        size_t compressed_byte_size() const;
+
+        static bool is_set(const std::vector<u32>& bits, size_t index) {
+            return (bits[index / 32] >> (index % 32)) & 1;
+        }
+
+    private:
+        BoundingBox _volume = {};
+        glm::uvec3 _cell_count = {};
+        size_t _object_count = 0;
+
+        // Per cell: sequence of [zero word count, literal word count, literals...]
+        std::vector<std::vector<u32>> _cells;
+};
+
+}
+
+#endif // POTENTIALLYVISIBLESET_H
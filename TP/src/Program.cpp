@@ -1,5 +1,7 @@
 #include "Program.h"
 
+#include <StateCache.h>
+
 #include <glad/glad.h>
 
 #include <algorithm>
@@ -168,12 +170,13 @@ void Program::fetch_uniform_locations() {
 
 Program::~Program() {
     if(_handle.is_valid()) {
+        forget_program(_handle.get());
         glDeleteProgram(_handle.get());
     }
 }
 
 void Program::bind() const {
-    glUseProgram(_handle.get());
+    bind_program(_handle.get());
 }
 
 bool Program::is_compute() const {
@@ -0,0 +1,139 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OM3D {
+
+static constexpr size_t radix = 256;
+static constexpr u32 radix_bits = 8;
+// Below this, starting the threads costs more than sorting
+static constexpr size_t min_keys_per_thread = 16 * 1024;
+
+using Histogram = std::array<u32, radix>;
+
+namespace {
+class Barrier : NonMovable {
+    public:
+        Barrier(size_t count) : _count(count) {
+        }
+
+        void wait() {
+            std::unique_lock lock(_mutex);
+            const u32 generation = _generation;
+            if(++_waiting == _count) {
+                _waiting = 0;
+                ++_generation;
+                _condition.notify_all();
+            } else {
+                _condition.wait(lock, [&] { return generation != _generation; });
+            }
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        const size_t _count;
+        size_t _waiting = 0;
+        u32 _generation = 0;
+};
+}
+
+void radix_sort(Span<u64> keys, Span<u32> values) {
+    DEBUG_ASSERT(keys.size() == values.size());
+
+    const size_t count = keys.size();
+    if(count < 2) {
+        return;
+    }
+
+    const size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    const size_t thread_count = std::clamp(count / min_keys_per_thread, size_t(1), max_threads);
+    const size_t chunk_size = (count + thread_count - 1) / thread_count;
+
+    std::vector<u64> key_scratch(count);
+    std::vector<u32> value_scratch(count);
+
+    // Each thread histograms its chunk, then scatters it at the offsets computed from all the histograms
+    std::vector<Histogram> histograms(thread_count);
+    bool skip_pass = false;
+    bool sorted_in_scratch = false;
+    Barrier barrier(thread_count);
+
+    auto sort_chunk = [&](size_t thread) {
+        u64* src_keys = keys.data();
+        u32* src_values = values.data();
+        u64* dst_keys = key_scratch.data();
+        u32* dst_values = value_scratch.data();
+
+        const size_t begin = std::min(thread * chunk_size, count);
+        const size_t end = std::min(begin + chunk_size, count);
+        Histogram& histogram = histograms[thread];
+
+        for(u32 shift = 0; shift < 64; shift += radix_bits) {
+            histogram.fill(0);
+            for(size_t i = begin; i != end; ++i) {
+                ++histogram[(src_keys[i] >> shift) & (radix - 1)];
+            }
+
+            barrier.wait();
+
+            if(thread == 0) {
+                // Turn the counts into scatter offsets: by digit, then by chunk to keep the sort stable
+                u32 offset = 0;
+                skip_pass = false;
+                for(size_t digit = 0; digit != radix; ++digit) {
+                    const u32 digit_begin = offset;
+                    for(Histogram& h : histograms) {
+                        const u32 digit_count = h[digit];
+                        h[digit] = offset;
+                        offset += digit_count;
+                    }
+                    skip_pass |= (offset - digit_begin == count);
+                }
+            }
+
+            barrier.wait();
+
+            if(skip_pass) {
+                continue;
+            }
+
+            for(size_t i = begin; i != end; ++i) {
+                const u32 dst = histogram[(src_keys[i] >> shift) & (radix - 1)]++;
+                dst_keys[dst] = src_keys[i];
+                dst_values[dst] = src_values[i];
+            }
+
+            std::swap(src_keys, dst_keys);
+            std::swap(src_values, dst_values);
+
+            // The next pass reads what the other threads wrote
+            barrier.wait();
+        }
+
+        if(thread == 0) {
+            sorted_in_scratch = (src_keys != keys.data());
+        }
+    };
+
+    std::vector<std::thread> threads(thread_count - 1);
+    for(size_t i = 0; i != threads.size(); ++i) {
+        threads[i] = std::thread(sort_chunk, i + 1);
+    }
+    sort_chunk(0);
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if(sorted_in_scratch) {
+        std::copy(key_scratch.begin(), key_scratch.end(), keys.data());
+        std::copy(value_scratch.begin(), value_scratch.end(), values.data());
+    }
+}
+
+}
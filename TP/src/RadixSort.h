@@ -0,0 +1,15 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <utils.h>
+
+namespace OM3D {
+
+// Stable LSD radix sort of values by increasing key, one byte per pass.
+// Passes where all keys share the same byte are skipped, so short keys are cheap.
+// Large inputs are split between threads, the result doesn't depend on the thread count.
+void radix_sort(Span<u64> keys, Span<u32> values);
+
+}
+
+#endif // RADIXSORT_H
@@ -0,0 +1,78 @@
+#ifndef RESIDENTBUFFER_H
+#define RESIDENTBUFFER_H
+
+#include <TypedBuffer.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace OM3D {
+
+// GPU copy of a CPU array that rarely changes. Changed index ranges are recorded
+// and only those are uploaded by sync(). The buffer is reallocated (and fully
+// uploaded) with doubled capacity when the array outgrows it.
+template<typename T>
+class ResidentBuffer : NonCopyable {
+    public:
+        ResidentBuffer() = default;
+
+        void mark_dirty(u32 begin, u32 end) {
+            // Most changes are sequential, merge with the last range when possible
+            if(!_dirty_ranges.empty() && _dirty_ranges.back().second >= begin && _dirty_ranges.back().first <= end) {
+                auto& range = _dirty_ranges.back();
+                range = {std::min(range.first, begin), std::max(range.second, end)};
+                return;
+            }
+            _dirty_ranges.emplace_back(begin, end);
+        }
+
+        bool needs_sync(size_t count) const {
+            return !_dirty_ranges.empty() || _buffer.element_count() < count;
+        }
+
+        // `get(i)` returns the i-th element of the CPU array, which has `count` elements
+        template<typename F>
+        void sync(size_t count, F&& get) {
+            std::vector<T> staging;
+            if(count > _buffer.element_count()) {
+                staging.reserve(count);
+                for(size_t i = 0; i != count; ++i) {
+                    staging.push_back(get(i));
+                }
+                staging.resize(std::max(_buffer.element_count() * 2, staging.size()));
+                _buffer = TypedBuffer<T>(staging.data(), staging.size());
+                _dirty_ranges.clear();
+                return;
+            }
+
+            std::sort(_dirty_ranges.begin(), _dirty_ranges.end());
+            u32 uploaded_end = 0;
+            for(auto [begin, end] : _dirty_ranges) {
+                begin = std::max(begin, uploaded_end);
+                end = std::min(end, u32(count));
+                if(begin >= end) {
+                    continue;
+                }
+
+                staging.clear();
+                for(u32 i = begin; i != end; ++i) {
+                    staging.push_back(get(i));
+                }
+                _buffer.update(begin, staging);
+                uploaded_end = end;
+            }
+            _dirty_ranges.clear();
+        }
+
+        void bind(BufferUsage usage, u32 index) const {
+            _buffer.bind(usage, index);
+        }
+
+    private:
+        TypedBuffer<T> _buffer;
+        std::vector<std::pair<u32, u32>> _dirty_ranges;
+};
+
+}
+
+#endif // RESIDENTBUFFER_H
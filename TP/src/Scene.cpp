@@ -1,397 +1,1444 @@
 #include "Scene.h"
 
-#include <TypedBuffer.h>
+#include <FrameAllocator.h>
+#include <RadixSort.h>
 
 #include <shader_structs.h>
 
 #include <glad/glad.h>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <tuple>
 
 namespace OM3D
 {
 
-    Scene::Scene()
+    Scene::Scene() : _depth_material(Material::depth_only_material())
     {
     }
 
-    void Scene::add_object(SceneObject obj)
+    ObjectHandle Scene::add_object(const SceneObject &obj)
     {
-        _objects.emplace_back(std::move(obj));
+        const u32 obj_index = u32(_transforms.size());
+
+        u32 handle_index = 0;
+        if (_free_handles.empty())
+        {
+            handle_index = u32(_handle_objects.size());
+            _handle_objects.push_back(obj_index);
+            _handle_generations.push_back(0);
+        }
+        else
+        {
+            handle_index = _free_handles.back();
+            _free_handles.pop_back();
+            _handle_objects[handle_index] = obj_index;
+        }
+
+        _transforms.push_back(obj.transform());
+        _world_bounds.emplace_back();
+        _world_spheres.emplace_back();
+        _mesh_ids.push_back(register_mesh(obj.get_mesh()));
+        _material_ids.push_back(register_material(obj.get_material()));
+        _flags.push_back(0);
+        _object_slots.emplace_back();
+        _object_handles.push_back(handle_index);
+
+        _transform_slots.emplace_back();
+
+        update_object_bounds(obj_index);
+        update_object_flags(obj_index);
+        add_object_transform(obj_index);
+        add_object_in_group(obj_index);
+
+        // Baked visibility is indexed by object
+        _pvs = PotentiallyVisibleSet();
+
+        return {handle_index, _handle_generations[handle_index]};
+    }
+
+    void Scene::remove_object(ObjectHandle handle)
+    {
+        ALWAYS_ASSERT(is_valid(handle), "Invalid object handle");
+
+        const u32 obj_index = _handle_objects[handle.index];
+        remove_object_from_group(obj_index);
+        remove_object_transform(obj_index);
+
+        ++_handle_generations[handle.index];
+        _free_handles.push_back(handle.index);
+
+        // Move the last object in the freed spot
+        const u32 last = u32(_transforms.size() - 1);
+        if (obj_index != last)
+        {
+            _transforms[obj_index] = _transforms[last];
+            _world_bounds[obj_index] = _world_bounds[last];
+            _world_spheres[obj_index] = _world_spheres[last];
+            _mesh_ids[obj_index] = _mesh_ids[last];
+            _material_ids[obj_index] = _material_ids[last];
+            _flags[obj_index] = _flags[last];
+            _object_slots[obj_index] = _object_slots[last];
+            _object_handles[obj_index] = _object_handles[last];
+            _transform_slots[obj_index] = _transform_slots[last];
+
+            const GroupSlot slot = _object_slots[obj_index];
+            _instanceGroups[slot.group].objects[slot.index] = obj_index;
+            _handle_objects[_object_handles[obj_index]] = obj_index;
+            if (_flags[obj_index] & ObjectFlagCompactTransform)
+                _compact_transforms.owners[_transform_slots[obj_index]] = obj_index;
+            else
+                _affine_transforms.owners[_transform_slots[obj_index]] = obj_index;
+        }
+
+        _transforms.pop_back();
+        _world_bounds.pop_back();
+        _world_spheres.pop_back();
+        _mesh_ids.pop_back();
+        _material_ids.pop_back();
+        _flags.pop_back();
+        _object_slots.pop_back();
+        _object_handles.pop_back();
+        _transform_slots.pop_back();
+
+        _pvs = PotentiallyVisibleSet();
+    }
+
+    bool Scene::is_valid(ObjectHandle handle) const
+    {
+        return handle.index < _handle_generations.size() && _handle_generations[handle.index] == handle.generation;
+    }
+
+    void Scene::set_object_transform(ObjectHandle handle, const glm::mat4 &transform)
+    {
+        ALWAYS_ASSERT(is_valid(handle), "Invalid object handle");
+
+        // The encoding might change, which moves the object to another group
+        const u32 obj_index = _handle_objects[handle.index];
+        remove_object_from_group(obj_index);
+        remove_object_transform(obj_index);
+        _transforms[obj_index] = transform;
+        update_object_bounds(obj_index);
+        add_object_transform(obj_index);
+        add_object_in_group(obj_index);
+    }
+
+    void Scene::set_object_material(ObjectHandle handle, std::shared_ptr<Material> material)
+    {
+        ALWAYS_ASSERT(is_valid(handle), "Invalid object handle");
+
+        set_object_material(_handle_objects[handle.index], register_material(material));
+    }
+
+    void Scene::set_object_material(u32 obj_index, u32 material_id)
+    {
+        remove_object_from_group(obj_index);
+        _material_ids[obj_index] = material_id;
+        update_object_flags(obj_index);
+        add_object_in_group(obj_index);
+    }
+
+    u32 Scene::register_mesh(const std::shared_ptr<StaticMesh> &mesh)
+    {
+        const auto [it, inserted] = _mesh_ids_by_ptr.try_emplace(mesh.get(), u32(_meshes.size()));
+        if (inserted)
+            _meshes.push_back(mesh);
+        return it->second;
+    }
+
+    u32 Scene::register_material(const std::shared_ptr<Material> &material)
+    {
+        const auto [it, inserted] = _material_ids_by_ptr.try_emplace(material.get(), u32(_materials.size()));
+        if (inserted)
+        {
+            _materials.push_back(material);
+            _material_states.push_back(register_material_state(material.get()));
+            _material_buffer.mark_dirty(it->second, it->second + 1);
+        }
+        return it->second;
+    }
+
+    u32 Scene::register_material_state(const Material *material)
+    {
+        // Null materials are never drawn, they get the empty state
+        std::vector<u32> state_key;
+        MaterialState state = {0, 0};
+        if (material)
+        {
+            state.program = _program_ids.try_emplace(material->program().get(), u32(_program_ids.size())).first->second;
+
+            std::vector<u32> textures;
+            for (const auto &[slot, texture] : material->textures())
+            {
+                textures.push_back(slot);
+                textures.push_back(texture ? texture->handle().get() : 0);
+            }
+            state.texture_set = _texture_set_ids.try_emplace(std::move(textures), u32(_texture_set_ids.size())).first->second;
+
+            state_key = {
+                state.program,
+                state.texture_set,
+                u32(material->blend_mode()),
+                u32(material->depth_test_mode()),
+                u32(material->depth_mask()),
+                u32(material->cull_mode())};
+        }
+
+        const auto [it, inserted] = _state_ids.try_emplace(std::move(state_key), u32(_states.size()));
+        if (inserted)
+            _states.push_back(state);
+        return it->second;
+    }
+
+    void Scene::update_object_bounds(u32 obj_index)
+    {
+        const StaticMesh *mesh = _meshes[_mesh_ids[obj_index]].get();
+        if (!mesh)
+        {
+            const glm::vec3 pos = glm::vec3(_transforms[obj_index][3]);
+            _world_bounds[obj_index] = {pos, pos};
+            _world_spheres[obj_index] = glm::vec4(pos, 0.0f);
+            return;
+        }
+
+        const glm::mat4 &transform = _transforms[obj_index];
+        const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+        const glm::vec3 center = glm::vec3(transform * glm::vec4(mesh->_bounding_sphere.center_pos, 1.0f));
+
+        _world_bounds[obj_index] = mesh->_bounding_box.transformed(transform);
+        _world_spheres[obj_index] = glm::vec4(center, mesh->_bounding_sphere.radius * scale);
+    }
+
+    void Scene::update_object_flags(u32 obj_index)
+    {
+        const StaticMesh *mesh = _meshes[_mesh_ids[obj_index]].get();
+        const Material *material = _materials[_material_ids[obj_index]].get();
+
+        u8 flags = _flags[obj_index] & ObjectFlagCompactTransform;
+        if (material && material->is_transparent())
+            flags |= ObjectFlagTransparent;
+        else if (mesh && !mesh->occluder_indices().is_empty())
+            flags |= ObjectFlagOccluder;
+        _flags[obj_index] = flags;
+    }
+
+    // Rotation + translation + uniform scale, fails for non-uniform scale, shear and mirroring
+    static bool encode_compact_transform(const glm::mat4 &transform, shader::CompactTransform &compact)
+    {
+        if (transform[0][3] != 0.0f || transform[1][3] != 0.0f || transform[2][3] != 0.0f || transform[3][3] != 1.0f)
+            return false;
+
+        const glm::mat3 basis = glm::mat3(transform);
+        const float scale = glm::length(basis[0]);
+        if (!(scale > 0.0f))
+            return false;
+
+        const glm::mat3 rotation = basis / scale;
+        constexpr float epsilon = 1e-4f;
+        for (int i = 0; i != 3; ++i)
+        {
+            if (std::abs(glm::length(rotation[i]) - 1.0f) > epsilon || std::abs(glm::dot(rotation[i], rotation[(i + 1) % 3])) > epsilon)
+                return false;
+        }
+        if (glm::determinant(rotation) < 0.0f)
+            return false;
+
+        const glm::quat q = glm::normalize(glm::quat_cast(rotation));
+        compact.rotation = glm::vec4(q.x, q.y, q.z, q.w);
+        compact.translation = glm::vec3(transform[3]);
+        compact.scale = scale;
+        return true;
+    }
+
+    static shader::AffineTransform encode_affine_transform(const glm::mat4 &transform)
+    {
+        const glm::mat4 rows = glm::transpose(transform);
+        return {{rows[0], rows[1], rows[2]}};
+    }
+
+    template<typename T>
+    static u32 add_transform(Scene::TransformStorage<T> &storage, const T &transform, u32 obj_index)
+    {
+        const u32 slot = u32(storage.transforms.size());
+        storage.transforms.push_back(transform);
+        storage.owners.push_back(obj_index);
+        storage.buffer.mark_dirty(slot, slot + 1);
+        return slot;
+    }
+
+    // Move the last transform in the freed slot
+    template<typename T>
+    static void remove_transform(Scene::TransformStorage<T> &storage, u32 slot, std::vector<u32> &transform_slots)
+    {
+        const u32 last = u32(storage.transforms.size() - 1);
+        if (slot != last)
+        {
+            storage.transforms[slot] = storage.transforms[last];
+            storage.owners[slot] = storage.owners[last];
+            transform_slots[storage.owners[slot]] = slot;
+            storage.buffer.mark_dirty(slot, slot + 1);
+        }
+        storage.transforms.pop_back();
+        storage.owners.pop_back();
+    }
+
+    void Scene::add_object_transform(u32 obj_index)
+    {
+        shader::CompactTransform compact = {};
+        if (encode_compact_transform(_transforms[obj_index], compact))
+        {
+            _flags[obj_index] |= ObjectFlagCompactTransform;
+            _transform_slots[obj_index] = add_transform(_compact_transforms, compact, obj_index);
+        }
+        else
+        {
+            _flags[obj_index] &= ~ObjectFlagCompactTransform;
+            _transform_slots[obj_index] = add_transform(_affine_transforms, encode_affine_transform(_transforms[obj_index]), obj_index);
+        }
+    }
+
+    void Scene::remove_object_transform(u32 obj_index)
+    {
+        if (_flags[obj_index] & ObjectFlagCompactTransform)
+            remove_transform(_compact_transforms, _transform_slots[obj_index], _transform_slots);
+        else
+            remove_transform(_affine_transforms, _transform_slots[obj_index], _transform_slots);
+    }
+
+    size_t Scene::object_count() const
+    {
+        return _transforms.size();
     }
 
     void Scene::add_object(PointLight obj)
     {
+        // The baked lights would miss it
+        if (obj.is_static())
+            _irradiance_volume = IrradianceVolume();
+
         _point_lights.emplace_back(std::move(obj));
+        _light_buffer.mark_dirty(u32(_point_lights.size() - 1), u32(_point_lights.size()));
     }
 
-    void Scene::deferred_render(const Camera &camera) const
+    size_t Scene::point_light_count() const
     {
-        // Fill and bind frame models buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
+        return _point_lights.size();
+    }
+
+    const PointLight &Scene::point_light(size_t index) const
+    {
+        return _point_lights[index];
+    }
+
+    void Scene::set_point_light(size_t index, PointLight light)
+    {
+        if (light.is_static() || _point_lights[index].is_static())
+            _irradiance_volume = IrradianceVolume();
+
+        _point_lights[index] = std::move(light);
+        _light_buffer.mark_dirty(u32(index), u32(index + 1));
+    }
+
+    void Scene::remove_point_light(size_t index)
+    {
+        if (_point_lights[index].is_static())
+            _irradiance_volume = IrradianceVolume();
+
+        // Move the last light in the freed spot, the count is part of the frame data
+        if (index != _point_lights.size() - 1)
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].camera.inv_view_proj = glm::inverse(camera.view_proj_matrix());
-            mapping[0].point_light_count = u32(_point_lights.size());
-            mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-            mapping[0].sun_dir = glm::normalize(_sun_direction);
+            _point_lights[index] = std::move(_point_lights.back());
+            _light_buffer.mark_dirty(u32(index), u32(index + 1));
         }
-        buffer.bind(BufferUsage::Uniform, 0);
+        _point_lights.pop_back();
+    }
 
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+    static shader::PointLight to_shader_light(const PointLight &light)
+    {
+        return {
+            light.position(),
+            light.radius(),
+            light.color(),
+            light.intensity()};
+    }
+
+    static shader::MaterialData to_shader_material(const Material *material)
+    {
+        shader::MaterialData data = {};
+        data.base_color_factor = glm::vec4(1.0f);
+        if (material)
+        {
+            data.base_color_factor = material->base_color_factor();
+            data.albedo_layer = material->texture_layer(0);
+            data.normal_layer = material->texture_layer(1);
+        }
+        return data;
     }
 
-    void Scene::render(const Camera &camera) const
+    FrameContext Scene::begin_frame(FrameAllocator &allocator, const Camera &camera, const LightLodSettings *light_lod, bool baked_lights) const
     {
-        Frustum frustum = camera.build_frustum();
+        if (_light_buffer.needs_sync(_point_lights.size()))
+            _light_buffer.sync(_point_lights.size(), [&](size_t i) { return to_shader_light(_point_lights[i]); });
+        if (_material_buffer.needs_sync(_materials.size()))
+            _material_buffer.sync(_materials.size(), [&](size_t i) { return to_shader_material(_materials[i].get()); });
+        if (_affine_transforms.buffer.needs_sync(_affine_transforms.transforms.size()))
+            _affine_transforms.buffer.sync(_affine_transforms.transforms.size(), [&](size_t i) { return _affine_transforms.transforms[i]; });
+        if (_compact_transforms.buffer.needs_sync(_compact_transforms.transforms.size()))
+            _compact_transforms.buffer.sync(_compact_transforms.transforms.size(), [&](size_t i) { return _compact_transforms.transforms[i]; });
+
+        FrameContext frame;
+        frame.allocator = &allocator;
+        frame.camera = camera;
+        frame.frustum = camera.build_frustum();
 
-        // Fill and bind frame models buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
+        frame.frame_data = allocator.allocate<shader::FrameData>(1);
+        shader::FrameData &data = frame.frame_data[0];
+        data.camera.view_proj = camera.view_proj_matrix();
+        data.camera.inv_view_proj = glm::inverse(camera.view_proj_matrix());
+        data.point_light_count = u32(_point_lights.size());
+        data.sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
+        data.sun_dir = glm::normalize(_sun_direction);
+
+        frame.baked_lights = baked_lights && !_irradiance_volume.is_empty();
+        data.irradiance_enabled = frame.baked_lights;
+        if (frame.baked_lights)
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].point_light_count = u32(_point_lights.size());
-            mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-            mapping[0].sun_dir = glm::normalize(_sun_direction);
+            const BoundingBox &volume = _irradiance_volume.volume();
+            data.irradiance_min = volume.min;
+            data.irradiance_inv_extent = 1.0f / (volume.max - volume.min);
         }
-        buffer.bind(BufferUsage::Uniform, 0);
 
-        // Fill and bind lights buffer
-        TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(_point_lights.size(), size_t(1)));
+        if (light_lod)
+            build_light_lod(frame, *light_lod);
+        else if (frame.baked_lights)
         {
-            auto mapping = light_buffer.map(AccessType::WriteOnly);
-            for (size_t i = 0; i != _point_lights.size(); ++i)
+            // Only the dynamic lights are shaded one by one
+            frame.filtered_lights = true;
+            for (const PointLight &light : _point_lights)
             {
-                const auto &light = _point_lights[i];
-                mapping[i] = {
-                    light.position(),
-                    light.radius(),
-                    light.color(),
-                    light.intensity()};
+                if (!light.is_static())
+                    frame.lights.push_back(to_shader_light(light));
             }
+            frame.light_buffer = allocator.allocate<shader::PointLight>(Span<const shader::PointLight>(frame.lights));
         }
-        light_buffer.bind(BufferUsage::Storage, 1);
+        if (frame.filtered_lights)
+            data.point_light_count = u32(frame.lights.size());
 
-        // Draw instanced
-        for (const std::vector<size_t> &instanceList : _instanceGroups)
-        {
-            size_t nb_instances_max = instanceList.size();
+        return frame;
+    }
 
-            // Init SSBO for models
-            std::vector<glm::mat4> models;
-            for (size_t i = 0; i < nb_instances_max; i++)
-            {
-                const SceneObject &obj = _objects[instanceList[i]];
-                // Instance culling
-                if (obj.is_visible(camera, frustum))
-                    models.push_back(obj.transform());
-            }
-            size_t nb_instances = models.size();
-            if (nb_instances == 0)
-                continue;
+    void Scene::bind_frame(const FrameContext &frame) const
+    {
+        frame.frame_data.bind(BufferUsage::Uniform, 0);
+        if (frame.filtered_lights)
+            frame.light_buffer.bind(BufferUsage::Storage, 1);
+        else
+            _light_buffer.bind(BufferUsage::Storage, 1);
+        _material_buffer.bind(BufferUsage::Storage, 6);
+        _affine_transforms.buffer.bind(BufferUsage::Storage, 2);
+        _compact_transforms.buffer.bind(BufferUsage::Storage, 4);
+        if (frame.baked_lights)
+            _irradiance_volume.bind(3);
+    }
 
-            const std::shared_ptr<Material> material = _objects[instanceList[0]].get_material();
-            const std::shared_ptr<StaticMesh> mesh = _objects[instanceList[0]].get_mesh();
-            material->bind();
-            mesh->bind_enable();
+    void Scene::bind_light_clusters(const LightClusters &clusters) const
+    {
+        clusters.data.bind(BufferUsage::Uniform, 3);
+        _cluster_lights.bind(BufferUsage::Storage, 0);
+        _cluster_light_indices.indices.bind(BufferUsage::Storage, 7);
+    }
 
-            TypedBuffer<glm::mat4> model_buffer(models.data(), nb_instances);
-            model_buffer.bind(BufferUsage::Storage, 2);
+    void Scene::deferred_render(const FrameContext &frame) const
+    {
+        bind_frame(frame);
 
-            glDrawElementsInstanced(GL_TRIANGLES, int(mesh->get_index_buffer().element_count()), GL_UNSIGNED_INT, 0, nb_instances);
-        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    static bool is_in_frustum(const Frustum &frustum, const glm::vec3 &camera_pos, const glm::vec4 &sphere)
+    {
+        const glm::vec3 dir = glm::vec3(sphere) - camera_pos;
+        const float r = sphere.w;
+        return glm::dot(dir, frustum._bottom_normal) > -r && glm::dot(dir, frustum._top_normal) > -r && glm::dot(dir, frustum._near_normal) > -r && glm::dot(dir, frustum._left_normal) > -r && glm::dot(dir, frustum._right_normal) > -r;
     }
 
-    void Scene::render_transparent(const Camera &camera, Texture &head_list, Texture &ll_buffer, bool transparency_fb) const
+    // Distance up to which the light adds at least quantum to a white surface facing it, 0 if it never does
+    static float light_reach(const PointLight &light, float quantum)
     {
-        Frustum frustum = camera.build_frustum();
+        const glm::vec3 &color = light.color();
+        const float peak = light.intensity() * std::max(color.r, std::max(color.g, color.b));
+        if (peak <= quantum)
+            return 0.0f;
 
-        // Fill and bind frame models buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
+        // The attenuation decreases with the distance
+        float near = 0.0f;
+        float far = light.radius();
+        for (int i = 0; i != 16; ++i)
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].point_light_count = u32(_point_lights.size());
-            mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-            mapping[0].sun_dir = glm::normalize(_sun_direction);
+            const float mid = (near + far) * 0.5f;
+            (peak * attenuation(mid, light.radius()) > quantum ? near : far) = mid;
         }
-        buffer.bind(BufferUsage::Uniform, 0);
+        return far;
+    }
 
-        // Fill and bind lights buffer
-        TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(_point_lights.size(), size_t(1)));
+    void Scene::build_light_lod(FrameContext &frame, const LightLodSettings &settings) const
+    {
+        enum class LightLod : u8
         {
-            auto mapping = light_buffer.map(AccessType::WriteOnly);
-            for (size_t i = 0; i != _point_lights.size(); ++i)
+            Dropped,
+            Kept,
+            Merged,
+            Baked
+        };
+
+        constexpr float quantum = 1.0f / 255.0f;
+        const Camera &camera = frame.camera;
+        const glm::vec3 camera_pos = camera.position();
+        // Pixels per world unit, at a distance of one
+        const float pixel_scale = 0.5f * settings.viewport_height * camera.projection_matrix()[1][1];
+
+        // Distance level of the merged lights, their cells are larger the further they are
+        std::vector<LightLod> lods(_point_lights.size());
+        std::vector<int> levels(_point_lights.size());
+        parallel_for(_point_lights.size(), 256, [&](size_t begin, size_t end)
+                     {
+            for (size_t i = begin; i != end; ++i)
             {
-                const auto &light = _point_lights[i];
-                mapping[i] = {
-                    light.position(),
-                    light.radius(),
-                    light.color(),
-                    light.intensity()};
+                const PointLight &light = _point_lights[i];
+                if (frame.baked_lights && light.is_static())
+                {
+                    lods[i] = LightLod::Baked;
+                    continue;
+                }
+
+                const float reach = light_reach(light, quantum);
+                const float dist = glm::length(light.position() - camera_pos);
+
+                // Nothing the camera sees is close enough to the lights out of the frustum
+                if (reach <= 0.0f || !is_in_frustum(frame.frustum, camera_pos, glm::vec4(light.position(), reach)))
+                {
+                    lods[i] = LightLod::Dropped;
+                    continue;
+                }
+                if (dist <= reach)
+                {
+                    lods[i] = LightLod::Kept;
+                    continue;
+                }
+
+                // Bounded by the peak over the whole projected disc of the reach
+                const glm::vec3 &color = light.color();
+                const float peak = light.intensity() * std::max(color.r, std::max(color.g, color.b)) / quantum;
+                const float pixel_radius = reach / dist * pixel_scale;
+                const float contribution = peak * glm::pi<float>() * pixel_radius * pixel_radius;
+                if (contribution < settings.min_contribution)
+                    lods[i] = LightLod::Dropped;
+                else if (pixel_radius * 2.0f < settings.merge_size)
+                {
+                    lods[i] = LightLod::Merged;
+                    levels[i] = std::max(0, int(std::floor(std::log2(dist))));
+                }
+                else
+                    lods[i] = LightLod::Kept;
+            } });
+
+        // Merged lights are grouped in world space cells whose edge projects to at most merge_size pixels
+        struct CellKey
+        {
+            int level;
+            glm::ivec3 cell;
+            bool operator==(const CellKey &other) const { return level == other.level && cell == other.cell; }
+        };
+        struct CellKeyHash
+        {
+            size_t operator()(const CellKey &key) const
+            {
+                size_t h = size_t(key.level);
+                hash_combine(h, size_t(u32(key.cell.x)));
+                hash_combine(h, size_t(u32(key.cell.y)));
+                hash_combine(h, size_t(u32(key.cell.z)));
+                return h;
             }
-        }
-        light_buffer.bind(BufferUsage::Storage, 1);
+        };
+        struct Cell
+        {
+            float weight = 0.0f;
+            glm::vec3 position = {};
+            glm::vec3 flux = {};
+            float intensity = 0.0f;
+            float radius = 0.0f;
+            u32 count = 0;
+            u32 first = 0;
+        };
 
-        glm::vec3 cam_pos = camera.position();
-        const glm::vec3 const_cam_pos = glm::vec3(cam_pos.x, cam_pos.y, cam_pos.z);
-        TypedBuffer<glm::vec3> camera_pos(&const_cam_pos, 1);
-        camera_pos.bind(BufferUsage::Uniform, 1);
+        std::unordered_map<CellKey, u32, CellKeyHash> cell_ids;
+        std::vector<Cell> cells;
+        std::vector<u32> light_cells(_point_lights.size());
+        for (size_t i = 0; i != _point_lights.size(); ++i)
+        {
+            if (lods[i] != LightLod::Merged)
+                continue;
 
-        const int max_size = ll_buffer.buffer_size();
-        TypedBuffer<int> max_storage_size(&max_size, 1);
-        max_storage_size.bind(BufferUsage::Uniform, 2);
+            const PointLight &light = _point_lights[i];
+            // The level is floor(log2(dist)), so the cell edge covers between merge_size / 2 and merge_size pixels in its band
+            const float cell_size = settings.merge_size / pixel_scale * std::exp2(float(levels[i]));
+            const CellKey key = {levels[i], glm::ivec3(glm::floor(light.position() / cell_size))};
+            const auto [it, inserted] = cell_ids.try_emplace(key, u32(cells.size()));
+            if (inserted)
+                cells.emplace_back().first = u32(i);
 
-        // Bind image2D HeadTexture;
-        head_list.bind_as_image(1, AccessType::ReadWrite);
+            Cell &cell = cells[it->second];
+            const glm::vec3 &color = light.color();
+            const float weight = light.intensity() * std::max(color.r, std::max(color.g, color.b));
+            cell.weight += weight;
+            cell.position += light.position() * weight;
+            cell.flux += color * light.intensity();
+            cell.intensity += light.intensity();
+            ++cell.count;
+            light_cells[i] = it->second;
+        }
 
-        // Bind SSBO - ListNodes
-        ll_buffer.bind_as_buffer(0);
+        for (Cell &cell : cells)
+            cell.position /= cell.weight;
+
+        // The virtual light reaches everything its lights reached
+        for (size_t i = 0; i != _point_lights.size(); ++i)
+        {
+            if (lods[i] == LightLod::Merged)
+            {
+                Cell &cell = cells[light_cells[i]];
+                cell.radius = std::max(cell.radius, glm::length(_point_lights[i].position() - cell.position) + _point_lights[i].radius());
+            }
+        }
 
-        uint counter = 0;
-        GLuint atomicsBuffer;
-        ByteBuffer::bind_atomic_buffer(atomicsBuffer, counter);
-        
-        for (const std::vector<size_t> &instanceList : _transparentInstanceGroups)
+        frame.filtered_lights = true;
+        frame.lights.clear();
+        for (size_t i = 0; i != _point_lights.size(); ++i)
         {
-            for (const size_t &obj_index : instanceList)
+            if (lods[i] == LightLod::Kept)
+                frame.lights.push_back(to_shader_light(_point_lights[i]));
+            else if (lods[i] == LightLod::Dropped)
+                ++frame.dropped_lights;
+        }
+        for (const Cell &cell : cells)
+        {
+            // Cells of a single light keep it as it is
+            if (cell.count == 1)
+                frame.lights.push_back(to_shader_light(_point_lights[cell.first]));
+            else
             {
-                _objects[obj_index].render(camera, frustum, transparency_fb);
+                frame.lights.push_back({cell.position, cell.radius, cell.flux / cell.intensity, cell.intensity});
+                frame.merged_lights += cell.count;
             }
         }
+
+        frame.light_buffer = frame.allocator->allocate<shader::PointLight>(Span<const shader::PointLight>(frame.lights));
+    }
+
+    size_t Scene::frame_light_count(const FrameContext &frame) const
+    {
+        return frame.filtered_lights ? frame.lights.size() : _point_lights.size();
+    }
+
+    glm::vec4 Scene::frame_light_sphere(const FrameContext &frame, size_t index) const
+    {
+        if (frame.filtered_lights)
+            return glm::vec4(frame.lights[index].position, frame.lights[index].radius);
+        return glm::vec4(_point_lights[index].position(), _point_lights[index].radius());
     }
 
-    void Scene::point_lights_render(const Camera &camera, std::shared_ptr<StaticMesh> sphere_mesh) const
+    void Scene::rasterize_occluders(const Camera &camera, const Frustum &frustum, OcclusionCuller &occlusion_culler) const
     {
-        Frustum frustum = camera.build_frustum();
+        occlusion_culler.clear(camera.view_proj_matrix());
+
+        // Pick the visible opaque objects that cover the most screen space as occluders
+        const glm::vec3 camera_pos = camera.position();
+        std::vector<std::pair<float, size_t>> candidates;
+        for (size_t i = 0; i != _flags.size(); ++i)
+        {
+            if (!(_flags[i] & ObjectFlagOccluder))
+                continue;
+
+            const BoundingBox &box = _world_bounds[i];
+            const float dist = std::max(glm::distance(box.center(), camera_pos), 1e-3f);
+            const float screen_size = 2.0f * glm::length(box.extent()) / dist;
+            if (screen_size >= occlusion_culler.min_occluder_size && is_in_frustum(frustum, camera_pos, _world_spheres[i]))
+                candidates.emplace_back(screen_size, i);
+        }
 
-        // Fill and bind frame models buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
+        const size_t occluder_count = std::min(candidates.size(), size_t(occlusion_culler.max_occluders));
+        std::partial_sort(candidates.begin(), candidates.begin() + occluder_count, candidates.end(), [](const auto &a, const auto &b)
+                          { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+
+        for (size_t i = 0; i != occluder_count; ++i)
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].camera.inv_view_proj = glm::inverse(camera.view_proj_matrix());
+            const size_t obj_index = candidates[i].second;
+            const StaticMesh &mesh = *_meshes[_mesh_ids[obj_index]];
+            occlusion_culler.add_occluder(mesh.occluder_positions(), mesh.occluder_indices(), _transforms[obj_index]);
         }
-        buffer.bind(BufferUsage::Uniform, 0);
+    }
+
+    // Distance from the camera plane to the nearest point of the sphere, clamped to 0
+    static float view_depth(const glm::vec3 &camera_pos, const glm::vec3 &camera_forward, const glm::vec4 &sphere)
+    {
+        return std::max(glm::dot(glm::vec3(sphere) - camera_pos, camera_forward) - sphere.w, 0.0f);
+    }
+
+    DrawList Scene::cull(const FrameContext &frame, OcclusionCuller *occlusion_culler, bool use_pvs) const
+    {
+        const Camera &camera = frame.camera;
+        const Frustum &frustum = frame.frustum;
+        const glm::vec3 camera_pos = camera.position();
+        const glm::vec3 camera_forward = camera.forward();
+
+        // Outside of the baked volume everything is potentially visible
+        std::vector<u32> pvs_bits;
+        const int pvs_cell = use_pvs ? _pvs.cell_index(camera.position()) : -1;
+        if (pvs_cell >= 0)
+            _pvs.decompress_cell(u32(pvs_cell), pvs_bits);
+
+        if (occlusion_culler)
+            rasterize_occluders(camera, frustum, *occlusion_culler);
 
-        for (size_t i = 0; i < _point_lights.size(); i++)
+        struct VisibleGroup
         {
-            const auto &pos = _point_lights[i].position();
-            const auto &radius = _point_lights[i].radius();
+            u32 group;
+            float nearest;
+            // Range in the visible arrays
+            u32 first;
+            u32 count;
+        };
 
-            // Compute only on point lights in the frustum
-            BoundingSphere bounds = {pos, radius};
-            if (!bounds.is_visible(camera, frustum))
+        std::vector<VisibleGroup> visible_groups;
+        std::vector<u32> visible;
+        std::vector<float> depths;
+        std::vector<float> state_nearest(_states.size(), std::numeric_limits<float>::max());
+        for (const u32 group_index : _group_order)
+        {
+            const InstanceGroup &group = _instanceGroups[group_index];
+            if (group.pass != RenderPass::Opaque || !_materials[group.material] || !_meshes[group.mesh])
                 continue;
 
-            // Fill and bind light buffer
-            TypedBuffer<shader::PointLight> light_buffer(nullptr, 1);
+            VisibleGroup visible_group = {group_index, std::numeric_limits<float>::max(), u32(visible.size()), 0};
+            for (const u32 obj_index : group.objects)
             {
-                auto mapping = light_buffer.map(AccessType::WriteOnly);
-                mapping[0] = {
-                    pos,
-                    radius,
-                    _point_lights[i].color(),
-                    _point_lights[i].intensity()};
+                if (pvs_cell >= 0 && !PotentiallyVisibleSet::is_set(pvs_bits, obj_index))
+                    continue;
+
+                // Instance culling
+                if (!is_in_frustum(frustum, camera_pos, _world_spheres[obj_index]))
+                    continue;
+                if (occlusion_culler && occlusion_culler->is_occluded(_world_bounds[obj_index]))
+                    continue;
+
+                const float depth = view_depth(camera_pos, camera_forward, _world_spheres[obj_index]);
+                visible_group.nearest = std::min(visible_group.nearest, depth);
+                visible.push_back(obj_index);
+                depths.push_back(depth);
             }
-            light_buffer.bind(BufferUsage::Uniform, 1);
 
-            glm::mat4 transform = glm::mat4(0.0f);
-            // Scale
-            transform[0][0] = radius;
-            transform[1][1] = radius;
-            transform[2][2] = radius;
-            // Translation
-            transform[0][3] = pos[0];
-            transform[1][3] = pos[1];
-            transform[2][3] = pos[2];
-            // final one
-            transform[3][3] = 1.0f;
+            visible_group.count = u32(visible.size()) - visible_group.first;
+            if (!visible_group.count)
+                continue;
+
+            state_nearest[group.state] = std::min(state_nearest[group.state], visible_group.nearest);
+            visible_groups.push_back(visible_group);
+        }
 
-            transform = glm::transpose(transform);
-            TypedBuffer<glm::mat4> model_buffer(&transform, 1);
-            model_buffer.bind(BufferUsage::Uniform, 2);
+        // Groups are drawn front to back, but groups of a state stay together so that they can still be merged
+        std::sort(visible_groups.begin(), visible_groups.end(), [&](const VisibleGroup &a, const VisibleGroup &b)
+                  {
+            const u32 a_state = _instanceGroups[a.group].state;
+            const u32 b_state = _instanceGroups[b.group].state;
+            if (a_state != b_state)
+                return std::tie(state_nearest[a_state], a_state) < std::tie(state_nearest[b_state], b_state);
+            return std::tie(a.nearest, a.group) < std::tie(b.nearest, b.group); });
 
-            sphere_mesh->draw();
+        // Instances are sorted by group rank, then front to back. Depths are positive so their bits sort like them.
+        std::vector<u64> keys(visible.size());
+        for (size_t rank = 0; rank != visible_groups.size(); ++rank)
+        {
+            const VisibleGroup &visible_group = visible_groups[rank];
+            for (u32 i = visible_group.first; i != visible_group.first + visible_group.count; ++i)
+            {
+                u32 depth_bits = 0;
+                std::memcpy(&depth_bits, &depths[i], sizeof(depth_bits));
+                keys[i] = (u64(rank) << 32) | depth_bits;
+            }
         }
+        radix_sort(keys, visible);
+
+        // Visible instances of all groups are packed in one list, each draw reads its own range
+        FrameAllocator &allocator = *frame.allocator;
+        DrawList draw_list;
+        draw_list.instances = allocator.allocate<shader::InstanceData>(visible.size());
+        draw_list.draws = allocator.allocate<shader::DrawData>(visible_groups.size());
+        draw_list.commands = allocator.allocate<DrawElementsIndirectCommand>(visible_groups.size());
+
+        u32 first_instance = 0;
+        for (size_t draw = 0; draw != visible_groups.size(); ++draw)
+        {
+            const VisibleGroup &visible_group = visible_groups[draw];
+            const InstanceGroup &group = _instanceGroups[visible_group.group];
+            for (u32 i = first_instance; i != first_instance + visible_group.count; ++i)
+                draw_list.instances[i] = {_transform_slots[visible[i]], _material_ids[visible[i]]};
+
+            const GeometryAllocation &geometry = _meshes[group.mesh]->geometry();
+            draw_list.draws[draw] = {first_instance, u32(group.format)};
+            draw_list.commands[draw] = {geometry.index_count, visible_group.count, geometry.first_index, geometry.base_vertex, 0};
+            draw_list.draw_groups.emplace_back(visible_group.group, visible_group.count);
+            first_instance += visible_group.count;
+        }
+
+        return draw_list;
+    }
+
+    void Scene::render_depth(const FrameContext &frame, const DrawList &draw_list, bool multi_draw) const
+    {
+        submit_draws(frame, draw_list, multi_draw, _depth_material.get(), false);
     }
 
-    void Scene::tiled_render(const Camera &camera, glm::uvec2 window_size, size_t tile_size) const {
+    void Scene::render(const FrameContext &frame, const DrawList &draw_list, bool multi_draw, bool depth_prepassed) const
+    {
+        submit_draws(frame, draw_list, multi_draw, nullptr, depth_prepassed);
+    }
+
+    void Scene::forward_render(const FrameContext &frame, const DrawList &draw_list, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, bool multi_draw) const
+    {
+        // Instances and transforms are at the bindings of the tiled passes
+        bind_tile_lights(frame, window_size, tile_size, gpu_light_lists, 0, 7);
 
-        glm::vec3 camera_forward = camera.forward();
-        glm::vec3 camera_up = camera.up();
-        glm::vec3 camera_right = camera.right();
+        const glm::uvec2 tile_grid(u32(tile_size), (window_size.x + u32(tile_size) - 1) / u32(tile_size));
+        const FrameAllocation<glm::uvec2> grid = frame.allocator->allocate<glm::uvec2>(Span<const glm::uvec2>(tile_grid));
+        grid.bind(BufferUsage::Uniform, 4);
 
-        float fov_y = camera.fov();
-        float fov_x = std::atan(std::tan(fov_y) * camera.aspect_ratio());
+        submit_draws(frame, draw_list, multi_draw, nullptr, true, true);
+    }
 
-        float n_x_tiles = window_size.x / tile_size;
-        float n_y_tiles = window_size.y / tile_size;
+    void Scene::submit_draws(const FrameContext &frame, const DrawList &draw_list, bool multi_draw, Material *depth_material, bool depth_equal, bool forward) const
+    {
+        bind_frame(frame);
 
-        std::vector<uint> plights_indices;
-        std::vector<uint> indices;
-        uint counter = 0;
+        draw_list.instances.bind(BufferUsage::Storage, 3);
+        draw_list.draws.bind(BufferUsage::Storage, 5);
+        draw_list.commands.bind(BufferUsage::Indirect);
 
-        for (size_t i = 0; i < window_size.y; i += tile_size)
+        // Depth only programs only read the positions
+        const VertexStream stream = depth_material ? VertexStream::Positions : VertexStream::Attributes;
+
+        const auto &draw_groups = draw_list.draw_groups;
+        for (size_t begin = 0; begin != draw_groups.size();)
         {
-            float top_fov = (fov_y * 0.5f) * -(1.0f - (((float(i) / float(tile_size) + 1.0f) * 2.0f) / n_y_tiles));  
-            float bottom_fov = (fov_y * 0.5f) * (1.0f - ((float(i) / float(tile_size) * 2.0f) / n_y_tiles));
-            
-            glm::vec3 top_normal = camera_forward * std::sin(top_fov) - camera_up * std::cos(top_fov);
-            glm::vec3 bottom_normal = camera_forward * std::sin(bottom_fov) + camera_up * std::cos(bottom_fov);
+            const InstanceGroup &group = _instanceGroups[draw_groups[begin].first];
+            const CullMode cull_mode = _materials[group.material]->cull_mode();
+            const bool position_stream = _meshes[group.mesh]->has_position_stream();
 
-            for (size_t j = 0; j < window_size.x; j += tile_size)
+            // Consecutive draws sharing a state are submitted together,
+            // depth only draws only need the same culling and vertex stream
+            auto same_bucket = [&](const InstanceGroup &other)
             {
-                float left_fov = (fov_x * 0.5f) * (1.0f - ((float(j) / float(tile_size) * 2.0f) / n_x_tiles));
-                float right_fov = (fov_x * 0.5f) * -(1.0f - (((float(j) / float(tile_size) + 1.0f) * 2.0f) / n_x_tiles));
+                if (depth_material)
+                    return _materials[other.material]->cull_mode() == cull_mode && _meshes[other.mesh]->has_position_stream() == position_stream;
+                return other.state == group.state;
+            };
 
-                glm::vec3 left_normal = camera_forward * std::sin(left_fov) + camera_right * std::cos(left_fov);
-                glm::vec3 right_normal = camera_forward * std::sin(right_fov) - camera_right * std::cos(right_fov);
+            size_t end = begin + 1;
+            if (multi_draw)
+            {
+                while (end != draw_groups.size() && same_bucket(_instanceGroups[draw_groups[end].first]))
+                    ++end;
+            }
 
-                Frustum frustum = { 
-                    camera_forward, // Stays the same
-                    top_normal, 
-                    bottom_normal, 
-                    right_normal, 
-                    left_normal
-                };
+            Material *material = depth_material ? depth_material : _materials[group.material].get();
+            material->bind(cull_mode, forward);
+            if (depth_equal)
+            {
+                // Only the fragments that won the depth pre-pass are shaded
+                bind_depth_test_mode(DepthTestMode::Equal);
+                bind_depth_mask(false);
+            }
+            (forward ? material->forward_program() : material->program())->set_uniform(HASH("draw_offset"), u32(begin));
 
-                for (size_t l = 0; l < _point_lights.size(); l++)
-                {
-                    const auto &pos = _point_lights[l].position();
-                    const auto &radius = _point_lights[l].radius();
-
-                    // Find the lights that alter the tile
-                    BoundingSphere bounds = {pos, radius};
-                    if (bounds.is_visible(camera, frustum)) {
-                        plights_indices.push_back(l);
-                        counter++;
-                    }
-                }
+            if (multi_draw)
+            {
+                // All meshes share the vertex arrays of the geometry arena
+                _meshes[group.mesh]->bind(stream);
+                const void *indirect = reinterpret_cast<const void *>(draw_list.commands.byte_offset() + begin * sizeof(DrawElementsIndirectCommand));
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, indirect, int(end - begin), 0);
+            }
+            else
+            {
+                _meshes[group.mesh]->draw_instanced(draw_groups[begin].second, stream);
+            }
+
+            begin = end;
+        }
+    }
+
+    // Inclusive range of tiles, empty if first > last
+    struct TileRect
+    {
+        glm::uvec2 first = glm::uvec2(1);
+        glm::uvec2 last = glm::uvec2(0);
+    };
+
+    // Bounds of tan(angle) from the camera axis of a circle in a plane containing the axis, clamped to the field of view
+    static glm::vec2 project_circle(float x, float z, float radius, float tan_half_fov)
+    {
+        // The circle contains the camera, even if the sphere does not
+        const float dist_sq = x * x + z * z;
+        if (dist_sq <= radius * radius)
+            return {-tan_half_fov, tan_half_fov};
+
+        // Tangents from the camera: the circle spans the angle of its center +/- asin(radius / distance)
+        const float center = std::atan2(x, z);
+        const float half_angle = std::asin(radius / std::sqrt(dist_sq));
+        constexpr float max_angle = glm::half_pi<float>() - 1e-3f;
+        return {
+            center - half_angle <= -max_angle ? -tan_half_fov : std::max(std::tan(center - half_angle), -tan_half_fov),
+            center + half_angle >= max_angle ? tan_half_fov : std::min(std::tan(center + half_angle), tan_half_fov)};
+    }
+
+    // Tiles covered by the projection of a bounding sphere, spheres behind the camera or off screen cover no tile
+    static TileRect project_sphere(const Camera &camera, const glm::vec4 &sphere, glm::uvec2 window_size, u32 tile_size)
+    {
+        // View space, z is the distance along the camera axis
+        const glm::vec3 view = glm::vec3(camera.view_matrix() * glm::vec4(glm::vec3(sphere), 1.0f));
+        const glm::vec3 center = glm::vec3(view.x, view.y, -view.z);
+        const float radius = sphere.w;
+
+        const glm::uvec2 tile_count = (window_size + glm::uvec2(tile_size - 1)) / tile_size;
+        TileRect rect;
+        if (center.z + radius <= 0.0f)
+            return rect;
 
-                indices.push_back(counter);
+        const glm::mat4 &proj = camera.projection_matrix();
+        const glm::vec2 tan_half_fov = glm::vec2(1.0f / proj[0][0], 1.0f / proj[1][1]);
+
+        glm::vec2 ndc_min = glm::vec2(-1.0f);
+        glm::vec2 ndc_max = glm::vec2(1.0f);
+        // The camera is inside the sphere, it covers the whole screen
+        if (glm::dot(center, center) > radius * radius)
+        {
+            for (int axis = 0; axis != 2; ++axis)
+            {
+                const glm::vec2 bounds = project_circle(center[axis], center.z, radius, tan_half_fov[axis]) / tan_half_fov[axis];
+                ndc_min[axis] = bounds.x;
+                ndc_max[axis] = bounds.y;
             }
         }
 
-        // Bind everything for the compute
+        const glm::vec2 pixel_min = (ndc_min * 0.5f + 0.5f) * glm::vec2(window_size);
+        const glm::vec2 pixel_max = (ndc_max * 0.5f + 0.5f) * glm::vec2(window_size);
+        if (pixel_min.x >= float(window_size.x) || pixel_min.y >= float(window_size.y) || pixel_max.x < 0.0f || pixel_max.y < 0.0f)
+            return rect;
+
+        rect.first = glm::min(glm::uvec2(glm::max(pixel_min, glm::vec2(0.0f))) / tile_size, tile_count - 1u);
+        rect.last = glm::min(glm::uvec2(glm::max(pixel_max, glm::vec2(0.0f))) / tile_size, tile_count - 1u);
+        return rect;
+    }
+
+    TransparencyLists::TransparencyLists(glm::uvec2 window_size, size_t node_count) : head_list(window_size, ImageFormat::R32_UINT, 0),
+                                                                                        nodes(node_count, ImageFormat::RGBA_32UI),
+                                                                                        node_counter(nullptr, 1)
+    {
+    }
+
+    void Scene::render_transparent(const FrameContext &frame, const LightClusters &clusters, TransparencyLists &lists, bool transparency_fb) const
+    {
+        FrameAllocator &allocator = *frame.allocator;
+        const Frustum &frustum = frame.frustum;
+
+        bind_frame(frame);
+        bind_light_clusters(clusters);
+
+        glm::vec3 cam_pos = frame.camera.position();
+        const glm::vec3 const_cam_pos = glm::vec3(cam_pos.x, cam_pos.y, cam_pos.z);
+        const FrameAllocation<glm::vec3> camera_pos = allocator.allocate<glm::vec3>(Span<const glm::vec3>(const_cam_pos));
+        camera_pos.bind(BufferUsage::Uniform, 1);
+
+        const int max_size = lists.nodes.buffer_size();
+        const FrameAllocation<int> max_storage_size = allocator.allocate<int>(Span<const int>(max_size));
+        max_storage_size.bind(BufferUsage::Uniform, 2);
+
+        // The lists and the counter of the previous frame were written by shaders, the clears must see those writes
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        // Only the pixels covered by the objects of the previous frame can hold a list
+        if (lists.dirty_first.x <= lists.dirty_last.x && lists.dirty_first.y <= lists.dirty_last.y)
+        {
+            const glm::uvec2 dirty_size = lists.dirty_last - lists.dirty_first + 1u;
+            glClearTexSubImage(lists.head_list.handle().get(), 0, lists.dirty_first.x, lists.dirty_first.y, 0, dirty_size.x, dirty_size.y, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        }
+        lists.node_counter.clear();
+
+        // Bind image2D HeadTexture;
+        lists.head_list.bind_as_image(1, AccessType::ReadWrite);
+
+        // Bind SSBO - ListNodes
+        lists.nodes.bind_as_buffer(0);
+
+        lists.node_counter.bind(BufferUsage::Atomic_counter, 0);
+
+        const glm::uvec2 window_size = lists.head_list.size();
+        TileRect dirty;
 
-        // Fill and bind frame models buffer
-        TypedBuffer<shader::FrameData> buffer(nullptr, 1);
+        // One draw per transparent object, filled as they are drawn
+        size_t transparent_count = 0;
+        for (const InstanceGroup &group : _instanceGroups)
         {
-            auto mapping = buffer.map(AccessType::WriteOnly);
-            mapping[0].camera.view_proj = camera.view_proj_matrix();
-            mapping[0].camera.inv_view_proj = glm::inverse(camera.view_proj_matrix());
-            mapping[0].point_light_count = u32(_point_lights.size());
-            mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-            mapping[0].sun_dir = glm::normalize(_sun_direction);
+            if (group.pass == RenderPass::Transparent)
+                transparent_count += group.objects.size();
         }
-        buffer.bind(BufferUsage::Uniform, 0);
+        const FrameAllocation<shader::InstanceData> instances = allocator.allocate<shader::InstanceData>(transparent_count);
+        const FrameAllocation<shader::DrawData> draws = allocator.allocate<shader::DrawData>(transparent_count);
+        instances.bind(BufferUsage::Storage, 3);
+        draws.bind(BufferUsage::Storage, 5);
 
-        // Fill and bind lights buffer
-        TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(_point_lights.size(), size_t(1)));
+        u32 draw_count = 0;
+        for (const u32 group_index : _group_order)
         {
-            auto mapping = light_buffer.map(AccessType::WriteOnly);
-            for (size_t i = 0; i != _point_lights.size(); ++i)
+            const InstanceGroup &group = _instanceGroups[group_index];
+            const Material *material = _materials[group.material].get();
+            const StaticMesh *mesh = _meshes[group.mesh].get();
+            if (group.pass != RenderPass::Transparent || !material || !mesh)
+                continue;
+
+            for (const u32 obj_index : group.objects)
             {
-                const auto &light = _point_lights[i];
-                mapping[i] = {
-                    light.position(),
-                    light.radius(),
-                    light.color(),
-                    light.intensity()};
+                if (!is_in_frustum(frustum, cam_pos, _world_spheres[obj_index]))
+                    continue;
+
+                // Pixels are tiles of size 1
+                const TileRect rect = project_sphere(frame.camera, _world_spheres[obj_index], window_size, 1);
+                if (rect.first.x > rect.last.x || rect.first.y > rect.last.y)
+                    continue;
+                const bool first_rect = dirty.first.x > dirty.last.x;
+                dirty.first = first_rect ? rect.first : glm::min(dirty.first, rect.first);
+                dirty.last = first_rect ? rect.last : glm::max(dirty.last, rect.last);
+
+                const u32 draw = draw_count++;
+                instances[draw] = {_transform_slots[obj_index], _material_ids[obj_index]};
+                draws[draw] = {draw, u32(group.format)};
+                _materials[group.material]->set_uniform(HASH("draw_offset"), draw);
+
+                if (transparency_fb)
+                {
+                    material->bind(CullMode::Frontface);
+                    mesh->draw();
+                    material->bind(CullMode::Backface);
+                    mesh->draw();
+                }
+                else
+                {
+                    material->bind();
+                    mesh->draw();
+                }
             }
         }
-        light_buffer.bind(BufferUsage::Storage, 1);
 
-        TypedBuffer<uint> indices_buffer(nullptr, std::max(indices.size(), size_t(1)));
+        lists.dirty_first = dirty.first;
+        lists.dirty_last = dirty.last;
+    }
+
+    void Scene::point_lights_render(const FrameContext &frame, std::shared_ptr<StaticMesh> sphere_mesh) const
+    {
+        bind_frame(frame);
+
+        // One instance of the sphere per light in the frustum, the shaders read the light from its index
+        const glm::vec3 camera_pos = frame.camera.position();
+        const size_t light_count = frame_light_count(frame);
+        const FrameAllocation<u32> visible_lights = frame.allocator->allocate<u32>(light_count);
+        u32 visible_count = 0;
+        for (size_t i = 0; i != light_count; ++i)
         {
-            auto mapping = indices_buffer.map(AccessType::WriteOnly);
-            for (size_t i = 0; i != indices.size(); ++i)
-                mapping[i] = indices[i];
+            if (is_in_frustum(frame.frustum, camera_pos, frame_light_sphere(frame, i)))
+                visible_lights[visible_count++] = u32(i);
         }
-        indices_buffer.bind(BufferUsage::Storage, 2);
-        TypedBuffer<uint> plights_indices_buffer(nullptr, std::max(plights_indices.size(), size_t(1)));
+
+        if (!visible_count)
+            return;
+
+        visible_lights.bind(BufferUsage::Storage, 3);
+        sphere_mesh->draw_instanced(visible_count, VertexStream::Positions);
+    }
+
+    template <typename F>
+    static void for_each_tile(const TileRect &rect, u32 tiles_per_row, F &&f)
+    {
+        for (u32 y = rect.first.y; y <= rect.last.y; ++y)
         {
-            auto mapping = plights_indices_buffer.map(AccessType::WriteOnly);
-            for (size_t i = 0; i != plights_indices.size(); ++i)
-                mapping[i] = plights_indices[i];
+            for (u32 x = rect.first.x; x <= rect.last.x; ++x)
+                f(size_t(y) * tiles_per_row + x);
         }
-        plights_indices_buffer.bind(BufferUsage::Storage, 3);
+    }
 
-        glDispatchCompute(align_up_to(window_size.x, 8) / 8, align_up_to(window_size.y, 8) / 8, 1);
+    void Scene::begin_light_index_pool(const FrameContext &frame, LightIndexPool &pool, size_t min_size)
+    {
+        const size_t required = std::max(min_size, size_t(pool.total.read(*frame.allocator)));
+        const size_t capacity = pool.indices.element_count();
+        if (capacity < required || capacity > std::max(min_size, required * 4))
+            pool.indices = TypedBuffer<u32>(nullptr, required == min_size ? min_size : required + required / 2);
+        if (!pool.counter.element_count())
+            pool.counter = TypedBuffer<u32>(nullptr, 1);
+        pool.counter.clear();
     }
 
-    void add_object_in_group(std::vector<std::vector<size_t>> &groups, std::vector<SceneObject> &objects, const SceneObject &obj, const int i)
+    void Scene::end_light_index_pool(const FrameContext &frame, LightIndexPool &pool)
     {
-        size_t index = 0;
-        // Find the good object in vector if doesn't exist -> create new vector
-        for (; index < groups.size(); index++)
+        pool.total.copy(*frame.allocator, pool.counter);
+    }
+
+    void Scene::cull_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size) const
+    {
+        const glm::uvec2 tile_count = (window_size + glm::uvec2(u32(tile_size) - 1)) / u32(tile_size);
+        const size_t tile_list_count = size_t(tile_count.x) * tile_count.y;
+        if (_tile_lights.element_count() != tile_list_count)
+            _tile_lights = TypedBuffer<glm::uvec2>(nullptr, tile_list_count);
+        _tile_light_size = tile_size;
+
+        bind_frame(frame);
+
+        begin_light_index_pool(frame, _tile_light_indices, tile_list_count * average_tile_lights);
+        _tile_lights.bind(BufferUsage::Storage, 2);
+        _tile_light_indices.indices.bind(BufferUsage::Storage, 3);
+        _tile_light_indices.counter.bind(BufferUsage::Storage, 7);
+
+        glDispatchCompute(tile_count.x, tile_count.y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        end_light_index_pool(frame, _tile_light_indices);
+    }
+
+    LightClusters Scene::build_light_clusters(const FrameContext &frame, glm::uvec2 window_size) const
+    {
+        static_assert(light_cluster_slices <= 64, "Slices are binned by one invocation of the group each");
+
+        const Camera &camera = frame.camera;
+        const glm::uvec2 tile_count = (window_size + glm::uvec2(light_cluster_tile_size - 1)) / light_cluster_tile_size;
+        const size_t cluster_count = size_t(tile_count.x) * tile_count.y * light_cluster_slices;
+        if (_cluster_lights.element_count() != cluster_count)
+            _cluster_lights = TypedBuffer<glm::uvec2>(nullptr, cluster_count);
+        begin_light_index_pool(frame, _cluster_light_indices, cluster_count * average_cluster_lights);
+
+        LightClusters clusters;
+        clusters.data = frame.allocator->allocate<shader::LightClusterData>(1);
+        shader::LightClusterData &data = clusters.data[0];
+        data.view = camera.view_matrix();
+        data.tan_half_fov = glm::vec2(1.0f / camera.projection_matrix()[0][0], 1.0f / camera.projection_matrix()[1][1]);
+        data.window_size = glm::vec2(window_size);
+        data.tile_count = tile_count;
+        data.tile_size = light_cluster_tile_size;
+        data.slice_count = light_cluster_slices;
+        data.slice_near = light_cluster_near;
+        data.slice_scale = float(light_cluster_slices) / std::log(light_cluster_far / light_cluster_near);
+
+        bind_frame(frame);
+        bind_light_clusters(clusters);
+
+        _cluster_light_indices.counter.bind(BufferUsage::Storage, 2);
+
+        glDispatchCompute(tile_count.x, tile_count.y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        end_light_index_pool(frame, _cluster_light_indices);
+
+        return clusters;
+    }
+
+    void Scene::tiled_render(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, const TileClassPrograms *tile_classes) const {
+
+        bind_frame(frame);
+
+        const glm::uvec2 tile_count = (window_size + glm::uvec2(u32(tile_size) - 1)) / u32(tile_size);
+        bind_tile_lights(frame, window_size, tile_size, gpu_light_lists, 2, 3);
+
+        if (!tile_classes)
         {
-            if (objects[groups[index][0]].same_type(obj))
-            {
-                groups[index].emplace_back(i);
-                break;
-            }
+            glDispatchCompute(tile_count.x, tile_count.y, 1);
+            return;
+        }
+
+        // Sort the tiles by class, then shade each class with its own variant, dispatched over the tiles of the class only
+        const size_t tile_list_count = size_t(tile_count.x) * tile_count.y;
+        if (_classified_tiles.element_count() != tile_list_count * tile_class_count)
+            _classified_tiles = TypedBuffer<u32>(nullptr, tile_list_count * tile_class_count);
+
+        // Filled by the classification, with one group per tile of the class
+        const FrameAllocation<DispatchIndirectCommand> dispatches = frame.allocator->allocate<DispatchIndirectCommand>(tile_class_count);
+        for (size_t tile_class = 0; tile_class != tile_class_count; ++tile_class)
+            dispatches[tile_class] = {0, 1, 1};
+
+        _classified_tiles.bind(BufferUsage::Storage, 5);
+        dispatches.bind(BufferUsage::Storage, 7);
+        dispatches.bind(BufferUsage::DispatchIndirect);
+
+        tile_classes->classification->bind();
+        tile_classes->classification->set_uniform(HASH("window_size"), glm::vec2(window_size));
+        glDispatchCompute(tile_count.x, tile_count.y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        for (size_t tile_class = 0; tile_class != tile_class_count; ++tile_class)
+        {
+            const std::shared_ptr<Program> &program = tile_classes->lighting[tile_class];
+            if (!program)
+                continue;
+
+            program->bind();
+            program->set_uniform(HASH("window_size"), glm::vec2(window_size));
+            glDispatchComputeIndirect(GLintptr(dispatches.byte_offset() + tile_class * sizeof(DispatchIndirectCommand)));
+        }
+    }
+
+    void Scene::bind_tile_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, u32 ranges_binding, u32 indices_binding) const
+    {
+        if (gpu_light_lists)
+        {
+            ALWAYS_ASSERT(tile_size == _tile_light_size, "Tile size doesn't match the light lists");
+            _tile_lights.bind(BufferUsage::Storage, ranges_binding);
+            _tile_light_indices.indices.bind(BufferUsage::Storage, indices_binding);
         }
+        else
+            bin_tile_lights(frame, window_size, tile_size, ranges_binding, indices_binding);
+    }
+
+    void Scene::bin_tile_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, u32 ranges_binding, u32 indices_binding) const
+    {
+        // Each light is projected once to the tiles it covers and only scattered into those
+        const glm::uvec2 tile_count = (window_size + glm::uvec2(u32(tile_size) - 1)) / u32(tile_size);
+        const size_t tile_list_count = size_t(tile_count.x) * tile_count.y;
+
+        const size_t light_count = frame_light_count(frame);
+        std::vector<TileRect> rects(light_count);
+        // Light count of each tile, then the next free slot in its list
+        std::vector<std::atomic<u32>> tile_cursors(tile_list_count);
+
+        parallel_for(light_count, 64, [&](size_t begin, size_t end)
+                     {
+            for (size_t l = begin; l != end; ++l)
+            {
+                rects[l] = project_sphere(frame.camera, frame_light_sphere(frame, l), window_size, u32(tile_size));
+                for_each_tile(rects[l], tile_count.x, [&](size_t tile) { tile_cursors[tile].fetch_add(1, std::memory_order_relaxed); });
+            } });
+
+        // Exclusive prefix sum of the counts, by blocks: block totals first, then each block with its offset
+        constexpr size_t scan_block_size = 4096;
+        const size_t block_count = (tile_list_count + scan_block_size - 1) / scan_block_size;
+        std::vector<u32> block_offsets(block_count + 1, 0);
+        parallel_for(block_count, 1, [&](size_t begin, size_t end)
+                     {
+            for (size_t block = begin; block != end; ++block)
+            {
+                const size_t last = std::min((block + 1) * scan_block_size, tile_list_count);
+                for (size_t tile = block * scan_block_size; tile != last; ++tile)
+                    block_offsets[block + 1] += tile_cursors[tile].load(std::memory_order_relaxed);
+            } });
+        for (size_t block = 0; block != block_count; ++block)
+            block_offsets[block + 1] += block_offsets[block];
+
+        // Lists are written straight into the mapped frame buffer
+        FrameAllocator &allocator = *frame.allocator;
+        const FrameAllocation<glm::uvec2> tiles = allocator.allocate<glm::uvec2>(tile_list_count);
+        const FrameAllocation<u32> light_indices = allocator.allocate<u32>(block_offsets[block_count]);
+
+        parallel_for(block_count, 1, [&](size_t begin, size_t end)
+                     {
+            for (size_t block = begin; block != end; ++block)
+            {
+                u32 offset = block_offsets[block];
+                const size_t last = std::min((block + 1) * scan_block_size, tile_list_count);
+                for (size_t tile = block * scan_block_size; tile != last; ++tile)
+                {
+                    const u32 count = tile_cursors[tile].load(std::memory_order_relaxed);
+                    tiles[tile] = {offset, count};
+                    tile_cursors[tile].store(offset, std::memory_order_relaxed);
+                    offset += count;
+                }
+            } });
+
+        parallel_for(light_count, 64, [&](size_t begin, size_t end)
+                     {
+            for (size_t l = begin; l != end; ++l)
+                for_each_tile(rects[l], tile_count.x, [&](size_t tile) { light_indices[tile_cursors[tile].fetch_add(1, std::memory_order_relaxed)] = u32(l); }); });
+
+        tiles.bind(BufferUsage::Storage, ranges_binding);
+        light_indices.bind(BufferUsage::Storage, indices_binding);
+    }
+
+    // 64 bit key, from most to least significant:
+    // pass (1) | program (12) | texture set (16) | material state (14) | mesh (20) | transform format (1)
+    // Groups sharing a state are consecutive so that the opaque pass can merge their draws.
+    // Ids are truncated to their field, which only affects the order of otherwise unrelated groups.
+    u64 Scene::group_sort_key(const BatchKey &key)
+    {
+        const MaterialState &state = _states[key.state];
 
-        if (index == groups.size())
+        auto field = [](u32 value, u32 bits) { return u64(value) & ((u64(1) << bits) - 1); };
+        return (field(u32(key.pass), 1) << 63)
+             | (field(state.program, 12) << 51)
+             | (field(state.texture_set, 16) << 35)
+             | (field(key.state, 14) << 21)
+             | (field(key.mesh, 20) << 1)
+             | field(u32(key.format), 1);
+    }
+
+    void Scene::add_object_in_group(u32 obj_index)
+    {
+        const BatchKey key = {
+            _mesh_ids[obj_index],
+            _material_states[_material_ids[obj_index]],
+            (_flags[obj_index] & ObjectFlagTransparent) ? RenderPass::Transparent : RenderPass::Opaque,
+            (_flags[obj_index] & ObjectFlagCompactTransform) ? TransformFormat::Compact : TransformFormat::Affine};
+
+        const auto [it, inserted] = _group_indices.try_emplace(key, u32(_instanceGroups.size()));
+        if (inserted)
         {
-            std::vector<size_t> newVector = std::vector<size_t>();
-            newVector.push_back(i);
-            groups.push_back(newVector);
+            const u64 sort_key = group_sort_key(key);
+            _instanceGroups.push_back({key.mesh, _material_ids[obj_index], key.state, key.pass, key.format, sort_key, {}});
+
+            // Keep the draw order sorted, groups with equal keys stay in creation order
+            const auto pos = std::upper_bound(_group_order.begin(), _group_order.end(), sort_key, [&](u64 k, u32 group) {
+                return k < _instanceGroups[group].sort_key;
+            });
+            _group_order.insert(pos, it->second);
         }
+
+        std::vector<u32> &objects = _instanceGroups[it->second].objects;
+        _object_slots[obj_index] = {it->second, u32(objects.size())};
+        objects.push_back(obj_index);
+    }
+
+    void Scene::remove_object_from_group(u32 obj_index)
+    {
+        const GroupSlot slot = _object_slots[obj_index];
+        std::vector<u32> &objects = _instanceGroups[slot.group].objects;
+
+        // Swap with the last object of the group
+        objects[slot.index] = objects.back();
+        _object_slots[objects[slot.index]].index = slot.index;
+        objects.pop_back();
     }
 
     void Scene::order_objects_in_lists()
     {
-        // TODO Could be better to do this directly when the object is added to _objects list
-        _instanceGroups = std::vector<std::vector<size_t>>();
-        _transparentInstanceGroups = std::vector<std::vector<size_t>>();
+        _instanceGroups.clear();
+        _group_indices.clear();
+        _group_order.clear();
+        for (u32 i = 0; i != u32(_transforms.size()); i++)
+        {
+            add_object_in_group(i);
+        }
+    }
+
+    BoundingBox Scene::bounds() const
+    {
+        if (_world_bounds.empty())
+            return {glm::vec3(0.0f), glm::vec3(0.0f)};
 
-        for (size_t i = 0; i < _objects.size(); i++)
+        BoundingBox bounds = _world_bounds[0];
+        for (const BoundingBox &box : _world_bounds)
         {
-            const SceneObject &obj = _objects[i];
+            bounds.min = glm::min(bounds.min, box.min);
+            bounds.max = glm::max(bounds.max, box.max);
+        }
+        return bounds;
+    }
 
-            if (obj.get_material()->is_transparent())
+    void Scene::bake_pvs(const BoundingBox &view_volume, const glm::uvec3 &cell_count)
+    {
+        std::vector<PotentiallyVisibleSet::Object> objects;
+        objects.reserve(_transforms.size());
+        for (size_t i = 0; i != _transforms.size(); ++i)
+        {
+            // Transparent objects and meshes too large for the software rasterizer never occlude
+            PotentiallyVisibleSet::Object &object = objects.emplace_back();
+            object.bounds = _world_bounds[i];
+            object.transform = _transforms[i];
+            if (_flags[i] & ObjectFlagOccluder)
             {
-                add_object_in_group(_transparentInstanceGroups, _objects, obj, i);
+                const StaticMesh *mesh = _meshes[_mesh_ids[i]].get();
+                object.occluder_positions = mesh->occluder_positions();
+                object.occluder_indices = mesh->occluder_indices();
             }
-            else
-                add_object_in_group(_instanceGroups, _objects, obj, i);
         }
+
+        _pvs = PotentiallyVisibleSet::bake(objects, view_volume, cell_count);
+    }
+
+    const PotentiallyVisibleSet &Scene::pvs() const
+    {
+        return _pvs;
+    }
+
+    void Scene::bake_static_lights(const BoundingBox &volume, const glm::uvec3 &probe_count)
+    {
+        std::vector<shader::PointLight> lights;
+        for (const PointLight &light : _point_lights)
+        {
+            if (light.is_static())
+                lights.push_back(to_shader_light(light));
+        }
+
+        _irradiance_volume = IrradianceVolume::bake(lights, volume, probe_count);
     }
 
-    const std::shared_ptr<StaticMesh> Scene::get_mesh(size_t obj_index) const
+    const IrradianceVolume &Scene::irradiance_volume() const
     {
-        return _objects[obj_index].get_mesh();
+        return _irradiance_volume;
     }
 
-    std::shared_ptr<Material> Scene::force_transparency(std::shared_ptr<Program> prog, int group_index)
+    const std::shared_ptr<StaticMesh> &Scene::get_mesh(size_t obj_index) const
     {
-        if (group_index < 0 || group_index >= _instanceGroups.size())
-            return nullptr;
+        return _meshes[_mesh_ids[obj_index]];
+    }
+
+    bool Scene::force_transparency(std::shared_ptr<Program> prog, int group_index)
+    {
+        if (group_index < 0 || size_t(group_index) >= _instanceGroups.size())
+            return false;
 
-        std::shared_ptr<Material> mat_copy = _objects[_instanceGroups[group_index][0]].get_material()->copy_material();
-        for (size_t i = 0; i < _instanceGroups[group_index].size(); i++)
+        const InstanceGroup &group = _instanceGroups[group_index];
+        if (group.pass != RenderPass::Opaque || group.objects.empty() || !_materials[group.material])
+            return false;
+
+        // Work on copies so other groups sharing the materials are not affected
+        const std::vector<u32> objects = group.objects;
+        for (const u32 obj_index : objects)
         {
-            _objects[_instanceGroups[group_index][i]].get_material()->set_blend_mode(BlendMode::Alpha);
-            _objects[_instanceGroups[group_index][i]].get_material()->set_depth_mask(GL_FALSE);
-            _objects[_instanceGroups[group_index][i]].get_material()->set_depth_test_mode(DepthTestMode::Reversed);
-            _objects[_instanceGroups[group_index][i]].get_material()->set_program(prog);
+            const u32 original = _material_ids[obj_index];
+            auto it = std::find_if(_forced_transparency.begin(), _forced_transparency.end(), [&](const auto &forced)
+                                   { return forced.first == original && _materials[forced.second]->program() == prog; });
+            if (it == _forced_transparency.end())
+            {
+                std::shared_ptr<Material> material = _materials[original]->copy_material();
+                material->set_blend_mode(BlendMode::Alpha);
+                material->set_depth_mask(GL_FALSE);
+                material->set_depth_test_mode(DepthTestMode::Reversed);
+                material->set_program(prog);
+
+                _forced_transparency.emplace_back(original, register_material(material));
+                it = _forced_transparency.end() - 1;
+            }
+            set_object_material(obj_index, it->second);
         }
 
-        this->order_objects_in_lists();
-        return mat_copy;
+        return true;
     }
 
-    void Scene::undo_transparency(std::shared_ptr<Material> mat)
+    void Scene::undo_transparency()
     {
-        if (_transparentInstanceGroups.size() == 0)
-            return;
-        for (size_t i = 0; i < _transparentInstanceGroups[0].size(); i++)
+        for (u32 i = 0; i != u32(_material_ids.size()); ++i)
         {
-            _objects[_transparentInstanceGroups[0][i]].set_material(mat);
+            for (const auto &[original, forced] : _forced_transparency)
+            {
+                if (_material_ids[i] == forced)
+                {
+                    set_object_material(i, original);
+                    break;
+                }
+            }
         }
-        this->order_objects_in_lists();
     }
 }
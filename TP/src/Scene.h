@@ -5,13 +5,166 @@
 #include <PointLight.h>
 #include <Camera.h>
 #include <Framebuffer.h>
+#include <FrameAllocator.h>
+#include <ResidentBuffer.h>
+#include <FrameReadback.h>
+#include <OcclusionCuller.h>
+#include <PotentiallyVisibleSet.h>
+#include <IrradianceVolume.h>
 #include <shader_structs.h>
 
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <array>
 
 namespace OM3D {
 
+enum class RenderPass {
+    Opaque,
+    Transparent,
+};
+
+// Stays valid until the object is removed, unlike its index in the scene arrays
+struct ObjectHandle {
+    u32 index = u32(-1);
+    u32 generation = 0;
+
+    bool operator==(const ObjectHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+enum ObjectFlags : u8 {
+    ObjectFlagTransparent = 0x01,
+    // Opaque and small enough to be rasterized by the OcclusionCuller
+    ObjectFlagOccluder = 0x02,
+    // Transform stored as a shader::CompactTransform instead of a shader::AffineTransform
+    ObjectFlagCompactTransform = 0x04,
+};
+
+// Encoding of the instance transforms, matches instances.glsl
+enum class TransformFormat : u32 {
+    // 3x4 matrix, 48 bytes
+    Affine,
+    // Rotation + translation + uniform scale, 32 bytes
+    Compact,
+};
+
+// Objects sharing a batch key are drawn together.
+// Materials with the same state (program, textures and render states) only differ by their
+// entry in the material table, which is read per instance, so they share groups.
+struct BatchKey {
+    u32 mesh = 0;
+    u32 state = 0;
+    RenderPass pass = RenderPass::Opaque;
+    TransformFormat format = TransformFormat::Affine;
+
+    bool operator==(const BatchKey& other) const {
+        return mesh == other.mesh && state == other.state && pass == other.pass && format == other.format;
+    }
+};
+
+struct BatchKeyHasher {
+    size_t operator()(const BatchKey& key) const noexcept {
+        size_t h = size_t(key.mesh);
+        hash_combine(h, size_t(key.state));
+        hash_combine(h, size_t(key.pass));
+        hash_combine(h, size_t(key.format));
+        return h;
+    }
+};
+
+struct InstanceGroup {
+    u32 mesh = 0;
+    // Material bound for the whole group, all the materials of the group share its state
+    u32 material = 0;
+    u32 state = 0;
+    RenderPass pass = RenderPass::Opaque;
+    TransformFormat format = TransformFormat::Affine;
+    // Groups are drawn by increasing key to minimize state changes (see Scene::group_sort_key)
+    u64 sort_key = 0;
+    // Indices in the scene object arrays
+    std::vector<u32> objects;
+};
+
+// Per frame simplification of the point lights, see Scene::begin_frame
+struct LightLodSettings {
+    // Lights whose contribution summed over the pixels they can reach is below this many display quanta (1/255) are dropped
+    float min_contribution = 16.0f;
+    // Lights smaller than this on screen, in pixels, are merged with their neighbours into virtual lights
+    float merge_size = 4.0f;
+    // Height in pixels of the viewport the sizes are measured in
+    float viewport_height = 900.0f;
+};
+
+// Per frame state shared by all the passes, built once by Scene::begin_frame
+struct FrameContext {
+    FrameAllocator* allocator = nullptr;
+    Camera camera;
+    Frustum frustum = {};
+    FrameAllocation<shader::FrameData> frame_data;
+
+    // Lights shaded one by one this frame, when the light LOD or the baked lights select them.
+    // The scene lights are shaded otherwise.
+    bool filtered_lights = false;
+    std::vector<shader::PointLight> lights;
+    FrameAllocation<shader::PointLight> light_buffer;
+    // Static lights are shaded from the irradiance volume of the scene instead
+    bool baked_lights = false;
+    // Scene lights dropped and merged by the light LOD
+    u32 dropped_lights = 0;
+    u32 merged_lights = 0;
+};
+
+// Visible opaque instances of a frame, built by Scene::cull and drawn by the opaque passes
+struct DrawList {
+    FrameAllocation<shader::InstanceData> instances;
+    FrameAllocation<shader::DrawData> draws;
+    FrameAllocation<DrawElementsIndirectCommand> commands;
+    // Group and instance count of each draw
+    std::vector<std::pair<u32, u32>> draw_groups;
+};
+
+// Light lists of the clusters of a frame, built by Scene::build_light_clusters and read by the forward passes
+struct LightClusters {
+    FrameAllocation<shader::LightClusterData> data;
+};
+
+// Per pixel lists of the transparent fragments, written by Scene::render_transparent and sorted by transparency.comp.
+// Kept between frames: only the pixels that may hold a list are cleared, on the GPU.
+struct TransparencyLists {
+    TransparencyLists(glm::uvec2 window_size, size_t node_count);
+
+    // First node of the list of each pixel, 0 for an empty list
+    Texture head_list;
+    Texture nodes;
+    TypedBuffer<u32> node_counter;
+    // Pixels written since the last clear, none when first > last
+    glm::uvec2 dirty_first = glm::uvec2(1);
+    glm::uvec2 dirty_last = glm::uvec2(0);
+};
+
+// Tile classes of the classified tiled lighting, values match the TILE_CLASS_ defines of tiles.glsl
+enum class TileClass : u32 {
+    // Background only
+    Sky,
+    // Geometry without point lights
+    Sun,
+    // At most FEW_TILE_LIGHTS lights
+    FewLights,
+    ManyLights,
+};
+
+static constexpr size_t tile_class_count = 4;
+
+// Programs of the classified tiled lighting, see Scene::tiled_render
+struct TileClassPrograms {
+    std::shared_ptr<Program> classification;
+    // Lighting variant of each tile class, classes without program are not shaded
+    std::array<std::shared_ptr<Program>, tile_class_count> lighting;
+};
+
 class Scene : NonMovable {
 
     public:
@@ -19,25 +172,197 @@ class Scene : NonMovable {
 
         static Result<std::unique_ptr<Scene>> from_gltf(const std::string& file_name);
 
-        void render(const Camera& camera) const;
-        void render_transparent(const Camera& camera, Texture &head_list, Texture &ll_buffer, bool transparency_fb) const;
-        void deferred_render(const Camera &camera) const;
-        void point_lights_render(const Camera &camera, std::shared_ptr<StaticMesh> sphere_mesh) const;
-        void tiled_render(const Camera &camera, glm::uvec2 window_size, size_t tile_size) const;
+        // Upload the lights changed since the last frame and fill the frame constants.
+        // With light_lod, the lights that can't be seen are dropped and the small distant ones merged for this frame.
+        // With baked_lights, the static lights are shaded from the irradiance volume, if they have been baked.
+        FrameContext begin_frame(FrameAllocator& allocator, const Camera& camera, const LightLodSettings* light_lod = nullptr, bool baked_lights = false) const;
+
+        // Visible instances are sorted front to back, groups are ordered by their nearest instance
+        DrawList cull(const FrameContext& frame, OcclusionCuller* occlusion_culler = nullptr, bool use_pvs = false) const;
+        // Depth only pass reading the position stream, so that render with depth_prepassed shades each pixel once
+        void render_depth(const FrameContext& frame, const DrawList& draw_list, bool multi_draw = true) const;
+        // With multi_draw, groups sharing a material state are drawn with a single glMultiDrawElementsIndirect
+        void render(const FrameContext& frame, const DrawList& draw_list, bool multi_draw = true, bool depth_prepassed = false) const;
+        void render_transparent(const FrameContext& frame, const LightClusters& clusters, TransparencyLists& lists, bool transparency_fb) const;
+        void deferred_render(const FrameContext &frame) const;
+        // Additive light volumes, a single instanced draw of sphere_mesh over the visible lights.
+        // The light volume material and the G-buffer textures must be bound, with the depth buffer attached.
+        void point_lights_render(const FrameContext &frame, std::shared_ptr<StaticMesh> sphere_mesh) const;
+        // Build the light list of each tile on the GPU, bounded by the depth of the tile.
+        // The light culling program compiled for tile_size and the depth buffer must be bound.
+        void cull_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size) const;
+        // One workgroup per tile, the tiled program must be compiled for tile_size.
+        // With gpu_light_lists, shades with the lists of cull_lights instead of binning the lights on the CPU.
+        // With tile_classes, the tiles are classified on the GPU and each class is shaded by its own program, dispatched indirectly.
+        void tiled_render(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, const TileClassPrograms *tile_classes = nullptr) const;
+        // Forward+ alternative to render and the tiled pass, after render_depth: the opaque objects are shaded by the
+        // forward programs of their materials, with the light lists of their tile. Tile lists are built as for tiled_render.
+        void forward_render(const FrameContext &frame, const DrawList &draw_list, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, bool multi_draw = true) const;
+        // Build the light lists of the clusters (screen tiles split in view distance slices) on the GPU,
+        // for the forward passes which have no depth buffer to bound the tiles. The light clustering program must be bound.
+        LightClusters build_light_clusters(const FrameContext &frame, glm::uvec2 window_size) const;
 
-        void add_object(SceneObject obj);
+        ObjectHandle add_object(const SceneObject& obj);
         void add_object(PointLight obj);
+
+        size_t point_light_count() const;
+        const PointLight& point_light(size_t index) const;
+        void set_point_light(size_t index, PointLight light);
+        void remove_point_light(size_t index);
+
+        void remove_object(ObjectHandle handle);
+        bool is_valid(ObjectHandle handle) const;
+        void set_object_transform(ObjectHandle handle, const glm::mat4& transform);
+        void set_object_material(ObjectHandle handle, std::shared_ptr<Material> material);
+        // Tile sizes the tiled light shaders can be compiled for, see tiles.glsl
+        static constexpr std::array<u32, 3> light_tile_sizes = {8, 16, 32};
+        // Initial capacity of the light index pool of cull_lights, per tile. The pool grows to the total of
+        // the previous frames, until it does the lists that don't fit are truncated, as are lists longer than
+        // MAX_TILE_LIGHTS in light_culling.comp
+        static constexpr u32 average_tile_lights = 64;
+        static constexpr u32 light_cluster_tile_size = 64;
+        // At most the group size of light_clusters.comp
+        static constexpr u32 light_cluster_slices = 24;
+        // View distances covered by the slices, the first and last slices extend to the camera and to infinity
+        static constexpr float light_cluster_near = 1.0f;
+        static constexpr float light_cluster_far = 2000.0f;
+        // Initial capacity of the light index pool of build_light_clusters, per cluster, grown like the tile pool.
+        // Clusters also keep at most MAX_TILE_LIGHTS of light_clusters.comp per screen tile
+        static constexpr u32 average_cluster_lights = 32;
+
+        // Rebuild all instance groups from scratch, groups are otherwise maintained incrementally
         void order_objects_in_lists();
-        const std::shared_ptr<StaticMesh> get_mesh(size_t obj_index) const;
+        size_t object_count() const;
+        const std::shared_ptr<StaticMesh>& get_mesh(size_t obj_index) const;
 
-        std::shared_ptr<Material> force_transparency(std::shared_ptr<Program> prog, int group_index); 
-        void undo_transparency(std::shared_ptr<Material> mat);
+        BoundingBox bounds() const;
+        void bake_pvs(const BoundingBox& view_volume, const glm::uvec3& cell_count);
+        const PotentiallyVisibleSet& pvs() const;
+        // Bake the static point lights in an irradiance volume. Adding, changing or removing static lights discards it.
+        void bake_static_lights(const BoundingBox& volume, const glm::uvec3& probe_count);
+        const IrradianceVolume& irradiance_volume() const;
+
+        // Draw the objects of a group with transparent copies of their materials
+        bool force_transparency(std::shared_ptr<Program> prog, int group_index);
+        void undo_transparency();
+
+        // Densely packed transforms of one format, with the object owning each slot
+        template<typename T>
+        struct TransformStorage {
+            std::vector<T> transforms;
+            std::vector<u32> owners;
+            mutable ResidentBuffer<T> buffer;
+        };
 
     private:
-        std::vector<SceneObject> _objects;
-        std::vector<std::vector<size_t>> _transparentInstanceGroups;
-        std::vector<std::vector<size_t>> _instanceGroups; 
+        struct GroupSlot {
+            u32 group;
+            u32 index;
+        };
+
+        // Light indices shared by the lists of a GPU light culling pass, allocated with an atomic counter.
+        // The total requested by each pass is read back without stalling a few frames later, and the pool grows to fit it.
+        struct LightIndexPool {
+            TypedBuffer<u32> indices;
+            TypedBuffer<u32> counter;
+            FrameReadback<u32> total;
+        };
+
+        // Before the pass: grow the pool to the total read back, at least to min_size, and clear the counter
+        static void begin_light_index_pool(const FrameContext &frame, LightIndexPool &pool, size_t min_size);
+        // After the pass: copy the total of the counter for a later frame
+        static void end_light_index_pool(const FrameContext &frame, LightIndexPool &pool);
+
+        void bind_frame(const FrameContext &frame) const;
+        void build_light_lod(FrameContext &frame, const LightLodSettings &settings) const;
+        // Lights bound by bind_frame, the light LOD of the frame or the scene lights
+        size_t frame_light_count(const FrameContext &frame) const;
+        glm::vec4 frame_light_sphere(const FrameContext &frame, size_t index) const;
+        void bind_light_clusters(const LightClusters &clusters) const;
+        // Bind the tile light lists of cull_lights, or build them on the CPU, to the given storage bindings
+        void bind_tile_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, u32 ranges_binding, u32 indices_binding) const;
+        void bin_tile_lights(const FrameContext &frame, glm::uvec2 window_size, size_t tile_size, u32 ranges_binding, u32 indices_binding) const;
+        // With forward, draws with the forward programs of the materials
+        void submit_draws(const FrameContext &frame, const DrawList &draw_list, bool multi_draw, Material *depth_material, bool depth_equal, bool forward = false) const;
+        void rasterize_occluders(const Camera &camera, const Frustum &frustum, OcclusionCuller &occlusion_culler) const;
+        u32 register_mesh(const std::shared_ptr<StaticMesh> &mesh);
+        u32 register_material(const std::shared_ptr<Material> &material);
+        u32 register_material_state(const Material *material);
+        void update_object_bounds(u32 obj_index);
+        void update_object_flags(u32 obj_index);
+        void set_object_material(u32 obj_index, u32 material_id);
+        void add_object_transform(u32 obj_index);
+        void remove_object_transform(u32 obj_index);
+        u64 group_sort_key(const BatchKey &key);
+        void add_object_in_group(u32 obj_index);
+        void remove_object_from_group(u32 obj_index);
+
+        // Objects are stored as parallel arrays, so that each pass only touches
+        // the attributes it needs. Removal moves the last object in the hole.
+        std::vector<glm::mat4> _transforms;
+        std::vector<BoundingBox> _world_bounds;
+        // xyz: center, w: radius
+        std::vector<glm::vec4> _world_spheres;
+        std::vector<u32> _mesh_ids;
+        std::vector<u32> _material_ids;
+        std::vector<u8> _flags;
+        // Position of each object in its instance group
+        std::vector<GroupSlot> _object_slots;
+        std::vector<u32> _object_handles;
+        // Slot in the transform storage of the object format
+        std::vector<u32> _transform_slots;
+
+        // Handle index -> object index, generations are bumped on removal
+        std::vector<u32> _handle_objects;
+        std::vector<u32> _handle_generations;
+        std::vector<u32> _free_handles;
+
+        // Meshes and materials are referenced by id, they are kept alive for the lifetime of the scene
+        std::vector<std::shared_ptr<StaticMesh>> _meshes;
+        std::vector<std::shared_ptr<Material>> _materials;
+        std::unordered_map<const StaticMesh*, u32> _mesh_ids_by_ptr;
+        std::unordered_map<const Material*, u32> _material_ids_by_ptr;
+
+        // Empty groups are kept so that group indices stay stable
+        std::vector<InstanceGroup> _instanceGroups;
+        std::unordered_map<BatchKey, u32, BatchKeyHasher> _group_indices;
+        // Group indices sorted by sort key
+        std::vector<u32> _group_order;
+        // Ids used to build the sort keys: materials sharing a program or textures get the same id
+        std::unordered_map<const Program*, u32> _program_ids;
+        std::unordered_map<std::vector<u32>, u32, CollectionHasher<std::vector<u32>>> _texture_set_ids;
+
+        struct MaterialState {
+            u32 program;
+            u32 texture_set;
+        };
+
+        // Material id -> state id
+        std::vector<u32> _material_states;
+        std::vector<MaterialState> _states;
+        std::unordered_map<std::vector<u32>, u32, CollectionHasher<std::vector<u32>>> _state_ids;
+
+        // Material replaced by force_transparency -> its transparent copy.
+        // Kept by undo_transparency, so forcing the same group again reuses the copies instead of registering new materials
+        std::vector<std::pair<u32, u32>> _forced_transparency;
         std::vector<PointLight> _point_lights;
+        // GPU copies, only the changed ranges are uploaded by begin_frame
+        mutable ResidentBuffer<shader::PointLight> _light_buffer;
+        mutable ResidentBuffer<shader::MaterialData> _material_buffer;
+        // Tile light lists built by cull_lights, sized for the last window
+        mutable TypedBuffer<glm::uvec2> _tile_lights;
+        mutable LightIndexPool _tile_light_indices;
+        mutable size_t _tile_light_size = 0;
+        // Tile list of each class, built by tiled_render
+        mutable TypedBuffer<u32> _classified_tiles;
+        // Cluster light lists built by build_light_clusters, sized for the last window
+        mutable TypedBuffer<glm::uvec2> _cluster_lights;
+        mutable LightIndexPool _cluster_light_indices;
+        TransformStorage<shader::AffineTransform> _affine_transforms;
+        TransformStorage<shader::CompactTransform> _compact_transforms;
+        PotentiallyVisibleSet _pvs;
+        IrradianceVolume _irradiance_volume;
+        std::shared_ptr<Material> _depth_material;
         glm::vec3 _sun_direction = glm::vec3(0.2f, 1.0f, 0.1f);
         Framebuffer g_buffer;
         
@@ -13,34 +13,73 @@ const Camera& SceneView::camera() const {
     return _camera;
 }
 
-void SceneView::render() const {
+FrameContext SceneView::begin_frame(FrameAllocator& allocator, const LightLodSettings* light_lod, bool baked_lights) const {
     if(_scene) {
-        _scene->render(_camera);
+        return _scene->begin_frame(allocator, _camera, light_lod, baked_lights);
     }
+    return {};
 }
 
-void SceneView::render_transparent(Texture &head_list, Texture &ll_buffer, bool transparency_fb) const {
+DrawList SceneView::cull(const FrameContext& frame, OcclusionCuller* occlusion_culler, bool use_pvs) const {
     if(_scene) {
-        _scene->render_transparent(_camera, head_list, ll_buffer, transparency_fb);
+        return _scene->cull(frame, occlusion_culler, use_pvs);
     }
+    return {};
 }
 
-void SceneView::deferred_render() const {
+void SceneView::render_depth(const FrameContext& frame, const DrawList& draw_list, bool multi_draw) const {
     if(_scene) {
-        _scene->deferred_render(_camera);
+        _scene->render_depth(frame, draw_list, multi_draw);
     }
 }
 
-void SceneView::point_lights_render(std::shared_ptr<StaticMesh> sphere_mesh) const {
+void SceneView::render(const FrameContext& frame, const DrawList& draw_list, bool multi_draw, bool depth_prepassed) const {
+    if(_scene) {
+        _scene->render(frame, draw_list, multi_draw, depth_prepassed);
+    }
+}
+
+void SceneView::render_transparent(const FrameContext& frame, const LightClusters& clusters, TransparencyLists& lists, bool transparency_fb) const {
+    if(_scene) {
+        _scene->render_transparent(frame, clusters, lists, transparency_fb);
+    }
+}
+
+void SceneView::deferred_render(const FrameContext& frame) const {
+    if(_scene) {
+        _scene->deferred_render(frame);
+    }
+}
+
+void SceneView::point_lights_render(const FrameContext& frame, std::shared_ptr<StaticMesh> sphere_mesh) const {
     if (_scene) {
-        _scene->point_lights_render(_camera, sphere_mesh);
+        _scene->point_lights_render(frame, sphere_mesh);
     }
 }
 
-void SceneView::tiled_render(glm::uvec2 window_size, size_t tile_size) const {
+void SceneView::cull_lights(const FrameContext& frame, glm::uvec2 window_size, size_t tile_size) const {
+    if(_scene) {
+        _scene->cull_lights(frame, window_size, tile_size);
+    }
+}
+
+void SceneView::tiled_render(const FrameContext& frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, const TileClassPrograms* tile_classes) const {
     if (_scene) {
-        _scene->tiled_render(_camera, window_size, tile_size);
+        _scene->tiled_render(frame, window_size, tile_size, gpu_light_lists, tile_classes);
     }    
 }
 
+void SceneView::forward_render(const FrameContext& frame, const DrawList& draw_list, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, bool multi_draw) const {
+    if (_scene) {
+        _scene->forward_render(frame, draw_list, window_size, tile_size, gpu_light_lists, multi_draw);
+    }
+}
+
+LightClusters SceneView::build_light_clusters(const FrameContext& frame, glm::uvec2 window_size) const {
+    if(_scene) {
+        return _scene->build_light_clusters(frame, window_size);
+    }
+    return {};
+}
+
 }
@@ -14,11 +14,17 @@ class SceneView {
         Camera& camera();
         const Camera& camera() const;
 
-        void render() const;
-        void render_transparent(Texture &head_list, Texture &ll_buffer, bool transparency_fb) const;
-        void deferred_render() const;
-        void point_lights_render(std::shared_ptr<StaticMesh> sphere_mesh) const;
-        void tiled_render(glm::uvec2 window_size, size_t tile_size) const;
+        FrameContext begin_frame(FrameAllocator& allocator, const LightLodSettings* light_lod = nullptr, bool baked_lights = false) const;
+        DrawList cull(const FrameContext& frame, OcclusionCuller* occlusion_culler = nullptr, bool use_pvs = false) const;
+        void render_depth(const FrameContext& frame, const DrawList& draw_list, bool multi_draw = true) const;
+        void render(const FrameContext& frame, const DrawList& draw_list, bool multi_draw = true, bool depth_prepassed = false) const;
+        void render_transparent(const FrameContext& frame, const LightClusters& clusters, TransparencyLists& lists, bool transparency_fb) const;
+        void deferred_render(const FrameContext& frame) const;
+        void point_lights_render(const FrameContext& frame, std::shared_ptr<StaticMesh> sphere_mesh) const;
+        void cull_lights(const FrameContext& frame, glm::uvec2 window_size, size_t tile_size) const;
+        void tiled_render(const FrameContext& frame, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, const TileClassPrograms* tile_classes = nullptr) const;
+        void forward_render(const FrameContext& frame, const DrawList& draw_list, glm::uvec2 window_size, size_t tile_size, bool gpu_light_lists, bool multi_draw = true) const;
+        LightClusters build_light_clusters(const FrameContext& frame, glm::uvec2 window_size) const;
 
     private:
         const Scene* _scene = nullptr;
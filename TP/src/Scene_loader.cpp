@@ -1,11 +1,13 @@
 #include "Scene.h"
 #include "StaticMesh.h"
+#include "TexturePacker.h"
 
 #include <glm/gtc/quaternion.hpp>
 
 #include <utils.h>
 
 #include <iostream>
+#include <map>
 
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -212,6 +214,74 @@ static Result<TextureData> build_texture_data(const tinygltf::Image& image, bool
 }
 
 
+// Textures are packed in arrays by size and format, so all of them are loaded before creating the materials
+static std::vector<std::shared_ptr<Material>> build_materials(const tinygltf::Model& gltf) {
+    TexturePacker packer;
+    std::map<std::pair<int, bool>, int> texture_indices;
+
+    auto add_texture = [&](const auto& texture_info, bool as_sRGB) -> int {
+        if(texture_info.texCoord != 0) {
+            std::cerr << "Unsupported texture coordinate channel (" << texture_info.texCoord << ")" << std::endl;
+            return -1;
+        }
+
+        if(texture_info.index < 0) {
+            return -1;
+        }
+
+        const int index = gltf.textures[texture_info.index].source;
+        if(index < 0) {
+            return -1;
+        }
+
+        const auto [it, inserted] = texture_indices.try_emplace({index, as_sRGB}, -1);
+        if(inserted) {
+            if(auto r = build_texture_data(gltf.images[index], as_sRGB); r.is_ok) {
+                it->second = int(packer.add(std::move(r.value)));
+            }
+        }
+        return it->second;
+    };
+
+    std::vector<std::pair<int, int>> material_textures;
+    for(const tinygltf::Material& material : gltf.materials) {
+        const int albedo = add_texture(material.pbrMetallicRoughness.baseColorTexture, true);
+        const int normal = add_texture(material.normalTexture, false);
+        material_textures.emplace_back(albedo, normal);
+    }
+
+    const std::vector<PackedTexture> textures = packer.pack();
+
+    std::vector<std::shared_ptr<Material>> materials;
+    for(size_t i = 0; i != gltf.materials.size(); ++i) {
+        const auto [albedo, normal] = material_textures[i];
+        const std::vector<double>& factor = gltf.materials[i].pbrMetallicRoughness.baseColorFactor;
+        const glm::vec4 base_color = factor.size() == 4 ? glm::vec4(factor[0], factor[1], factor[2], factor[3]) : glm::vec4(1.0f);
+
+        std::shared_ptr<Material> mat;
+        if(albedo < 0) {
+            mat = Material::empty_material();
+            if(base_color != mat->base_color_factor()) {
+                mat = std::make_shared<Material>(*mat);
+                mat->set_base_color_factor(base_color);
+            }
+        } else if(normal < 0) {
+            mat = std::make_shared<Material>(Material::textured_material());
+            mat->set_texture(0u, textures[albedo].array, textures[albedo].layer);
+            mat->set_base_color_factor(base_color);
+        } else {
+            mat = std::make_shared<Material>(Material::textured_normal_mapped_material());
+            mat->set_texture(0u, textures[albedo].array, textures[albedo].layer);
+            mat->set_texture(1u, textures[normal].array, textures[normal].layer);
+            mat->set_base_color_factor(base_color);
+        }
+
+        materials.push_back(std::move(mat));
+    }
+
+    return materials;
+}
+
 static glm::mat4 parse_node_matrix(const tinygltf::Node& node) {
     glm::vec3 translation(0.0f, 0.0f, 0.0f);
     for(u32 k = 0; k != node.translation.size(); ++k) {
@@ -318,8 +388,7 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
 
     auto scene = std::make_unique<Scene>();
 
-    std::unordered_map<int, std::shared_ptr<Texture>> textures;
-    std::unordered_map<int, std::shared_ptr<Material>> materials;
+    std::vector<std::shared_ptr<Material>> materials = build_materials(gltf);
     std::unordered_map<int, glm::mat4> node_transforms;
 
     {
@@ -364,52 +433,7 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
 
             std::shared_ptr<Material> material;
             if(prim.material >= 0) {
-                auto& mat = materials[prim.material];
-
-                if(!mat) {
-                    const auto& albedo_info = gltf.materials[prim.material].pbrMetallicRoughness.baseColorTexture;
-                    const auto& normal_info = gltf.materials[prim.material].normalTexture;
-
-                    auto load_texture = [&](auto texture_info, bool as_sRGB) -> std::shared_ptr<Texture> {
-                        if(texture_info.texCoord != 0) {
-                            std::cerr << "Unsupported texture coordinate channel (" << texture_info.texCoord << ")" << std::endl;
-                            return nullptr;
-                        }
-
-                        if(texture_info.index < 0) {
-                            return nullptr;
-                        }
-
-                        const int index = gltf.textures[texture_info.index].source;
-                        if(index < 0) {
-                            return nullptr;
-                        }
-
-                        auto& texture = textures[index];
-                        if(!texture) {
-                            if(const auto r = build_texture_data(gltf.images[index], as_sRGB); r.is_ok) {
-                                texture = std::make_shared<Texture>(r.value);
-                            }
-                        }
-                        return texture;
-                    };
-
-                    auto albedo = load_texture(albedo_info, true);
-                    auto normal = load_texture(normal_info, false);
-
-                    if(!albedo) {
-                        mat = Material::empty_material();
-                    } else if(!normal) {
-                        mat = std::make_shared<Material>(Material::textured_material());
-                        mat->set_texture(0u, albedo);
-                    } else {
-                        mat = std::make_shared<Material>(Material::textured_normal_mapped_material());
-                        mat->set_texture(0u, albedo);
-                        mat->set_texture(1u, normal);
-                    }
-                }
-
-                material = mat;
+                material = materials[prim.material];
             }
 
             auto scene_object = SceneObject(std::make_shared<StaticMesh>(mesh.value), std::move(material));
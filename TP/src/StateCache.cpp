@@ -0,0 +1,169 @@
+#include "StateCache.h"
+
+#include <glad/glad.h>
+
+#include <array>
+
+namespace OM3D {
+
+static constexpr u32 unknown_state = u32(-1);
+static constexpr u32 max_texture_units = 32;
+
+static struct {
+    u32 blend_mode = unknown_state;
+    u32 depth_test_mode = unknown_state;
+    u32 depth_mask = unknown_state;
+    u32 cull_mode = unknown_state;
+    u32 program = unknown_state;
+    u32 vertex_array = unknown_state;
+    std::array<u32, max_texture_units> textures = [] {
+        std::array<u32, max_texture_units> textures;
+        textures.fill(unknown_state);
+        return textures;
+    }();
+
+    StateChangeCounters counters;
+} state;
+
+// Returns true if the state has to be set
+static bool update(u32& cached, u32 value) {
+    if(cached == value) {
+        ++state.counters.filtered;
+        return false;
+    }
+    cached = value;
+    ++state.counters.issued;
+    return true;
+}
+
+void bind_blend_mode(BlendMode mode) {
+    if(!update(state.blend_mode, u32(mode))) {
+        return;
+    }
+
+    switch(mode) {
+        case BlendMode::None:
+            glDisable(GL_BLEND);
+        break;
+
+        case BlendMode::Alpha:
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+
+        case BlendMode::Additive:
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        break;
+    }
+}
+
+void bind_depth_test_mode(DepthTestMode mode) {
+    if(!update(state.depth_test_mode, u32(mode))) {
+        return;
+    }
+
+    switch(mode) {
+        case DepthTestMode::None:
+            glDisable(GL_DEPTH_TEST);
+        break;
+
+        case DepthTestMode::Equal:
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_EQUAL);
+        break;
+
+        case DepthTestMode::Standard:
+            glEnable(GL_DEPTH_TEST);
+            // We are using reverse-Z
+            glDepthFunc(GL_GEQUAL);
+        break;
+
+        case DepthTestMode::Reversed:
+            glEnable(GL_DEPTH_TEST);
+            // We are using reverse-Z
+            glDepthFunc(GL_LEQUAL);
+        break;
+    }
+}
+
+void bind_depth_mask(bool mask) {
+    if(update(state.depth_mask, u32(mask))) {
+        glDepthMask(mask ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void bind_cull_mode(CullMode mode) {
+    if(!update(state.cull_mode, u32(mode))) {
+        return;
+    }
+
+    switch(mode) {
+        case CullMode::None:
+            glDisable(GL_CULL_FACE);
+        break;
+
+        case CullMode::Backface:
+            glCullFace(GL_BACK);
+            glEnable(GL_CULL_FACE);
+        break;
+
+        case CullMode::Frontface:
+            glCullFace(GL_FRONT);
+            glEnable(GL_CULL_FACE);
+        break;
+    }
+}
+
+void bind_program(u32 handle) {
+    if(update(state.program, handle)) {
+        glUseProgram(handle);
+    }
+}
+
+void bind_texture_unit(u32 unit, u32 handle) {
+    if(unit >= max_texture_units) {
+        ++state.counters.issued;
+        glBindTextureUnit(unit, handle);
+        return;
+    }
+    if(update(state.textures[unit], handle)) {
+        glBindTextureUnit(unit, handle);
+    }
+}
+
+void bind_vertex_array(u32 handle) {
+    if(update(state.vertex_array, handle)) {
+        glBindVertexArray(handle);
+    }
+}
+
+void forget_texture(u32 handle) {
+    for(u32& texture : state.textures) {
+        if(texture == handle) {
+            texture = unknown_state;
+        }
+    }
+}
+
+void forget_program(u32 handle) {
+    if(state.program == handle) {
+        state.program = unknown_state;
+    }
+}
+
+void forget_vertex_array(u32 handle) {
+    if(state.vertex_array == handle) {
+        state.vertex_array = unknown_state;
+    }
+}
+
+const StateChangeCounters& state_change_counters() {
+    return state.counters;
+}
+
+void reset_state_change_counters() {
+    state.counters = {};
+}
+
+}
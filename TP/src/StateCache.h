@@ -0,0 +1,54 @@
+#ifndef STATECACHE_H
+#define STATECACHE_H
+
+#include <graphics.h>
+
+namespace OM3D {
+
+enum class BlendMode {
+    None,
+    Alpha,
+    Additive,
+};
+
+enum class CullMode {
+    None, 
+    Backface,
+    Frontface,
+};
+
+enum class DepthTestMode {
+    Standard,
+    Reversed,
+    Equal,
+    None
+};
+
+struct StateChangeCounters {
+    // State changes that reached the driver
+    u32 issued = 0;
+    // Redundant state changes that were skipped
+    u32 filtered = 0;
+};
+
+// Shadow copy of the pipeline state set by materials, programs and textures.
+// All of this state must be set through these functions for the cache to stay valid.
+void bind_blend_mode(BlendMode mode);
+void bind_depth_test_mode(DepthTestMode mode);
+void bind_depth_mask(bool mask);
+void bind_cull_mode(CullMode mode);
+void bind_program(u32 handle);
+void bind_texture_unit(u32 unit, u32 handle);
+void bind_vertex_array(u32 handle);
+
+// Must be called when a texture, program or vertex array is destroyed, as GL names are reused
+void forget_texture(u32 handle);
+void forget_program(u32 handle);
+void forget_vertex_array(u32 handle);
+
+const StateChangeCounters& state_change_counters();
+void reset_state_change_counters();
+
+}
+
+#endif // STATECACHE_H
@@ -6,8 +6,9 @@
 namespace OM3D
 {
 
-    StaticMesh::StaticMesh(const MeshData &data) : _vertex_buffer(data.vertices),
-                                                   _index_buffer(data.indices)
+    StaticMesh::StaticMesh(const MeshData &data, bool position_stream) : _arena(GeometryArena::arena()),
+                                                                         _geometry(_arena->allocate(data.vertices, data.indices, position_stream)),
+                                                                         _position_stream(position_stream)
     {
         glm::vec3 origin = {0, 0, 0};
         for (size_t i = 0; i < data.vertices.size(); ++i)
@@ -31,54 +32,58 @@ namespace OM3D
         //std::cout << origin.x << "," << origin.y << "," << origin.z << " | " << radius << std::endl;
 
         _bounding_sphere = {origin, radius};
-    }
 
-    void StaticMesh::draw() const
-    {
-        _vertex_buffer.bind(BufferUsage::Attribute);
-        _index_buffer.bind(BufferUsage::Index);
+        glm::vec3 box_min = data.vertices.empty() ? glm::vec3(0.0f) : data.vertices[0].position;
+        glm::vec3 box_max = box_min;
+        for (const Vertex &vertex : data.vertices)
+        {
+            box_min = glm::min(box_min, vertex.position);
+            box_max = glm::max(box_max, vertex.position);
+        }
+        _bounding_box = {box_min, box_max};
 
-        // Vertex position
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-        // Vertex normal
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(3 * sizeof(float)));
-        // Vertex uv
-        glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(6 * sizeof(float)));
-        // Tangent / bitangent sign
-        glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(8 * sizeof(float)));
-        // Vertex color
-        glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(12 * sizeof(float)));
+        if (data.indices.size() / 3 <= max_occluder_triangles)
+        {
+            _occluder_positions.reserve(data.vertices.size());
+            for (const Vertex &vertex : data.vertices)
+            {
+                _occluder_positions.push_back(vertex.position);
+            }
+            _occluder_indices = data.indices;
+        }
+    }
 
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(3);
-        glEnableVertexAttribArray(4);
+    StaticMesh::~StaticMesh()
+    {
+        if (_arena)
+        {
+            _arena->free(_geometry);
+        }
+    }
 
-        glDrawElements(GL_TRIANGLES, int(_index_buffer.element_count()), GL_UNSIGNED_INT, nullptr);
+    void StaticMesh::bind(VertexStream stream) const
+    {
+        if (_arena)
+        {
+            _arena->bind(_position_stream ? stream : VertexStream::Attributes);
+        }
     }
 
-    void StaticMesh::bind_enable() const
+    void StaticMesh::draw() const
     {
-        _vertex_buffer.bind(BufferUsage::Attribute);
-        _index_buffer.bind(BufferUsage::Index);
+        draw_instanced(1);
+    }
 
-        // Vertex position
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-        // Vertex normal
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(3 * sizeof(float)));
-        // Vertex uv
-        glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(6 * sizeof(float)));
-        // Tangent / bitangent sign
-        glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(8 * sizeof(float)));
-        // Vertex color
-        glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(12 * sizeof(float)));
+    void StaticMesh::draw_instanced(u32 instance_count, VertexStream stream) const
+    {
+        if (!_geometry.index_count)
+        {
+            return;
+        }
 
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(3);
-        glEnableVertexAttribArray(4);
+        bind(stream);
+        const void *index_offset = reinterpret_cast<const void *>(size_t(_geometry.first_index) * sizeof(u32));
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, int(_geometry.index_count), GL_UNSIGNED_INT, index_offset, int(instance_count), int(_geometry.base_vertex));
     }
 
 }
@@ -4,7 +4,7 @@
 #include "Camera.h"
 
 #include <graphics.h>
-#include <TypedBuffer.h>
+#include <GeometryArena.h>
 #include <Vertex.h>
 
 #include <vector>
@@ -34,28 +34,83 @@ namespace OM3D
         }
     };
 
-    class StaticMesh : NonCopyable
+    struct BoundingBox
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        glm::vec3 center() const
+        {
+            return (min + max) * 0.5f;
+        }
+
+        glm::vec3 extent() const
+        {
+            return (max - min) * 0.5f;
+        }
+
+        BoundingBox transformed(const glm::mat4 &transform) const
+        {
+            // Arvo's method: transform the center and accumulate the absolute extents
+            const glm::vec3 c = glm::vec3(transform * glm::vec4(center(), 1.0f));
+            const glm::vec3 e = extent();
+            glm::vec3 half = glm::vec3(0.0f);
+            for (int i = 0; i != 3; ++i)
+            {
+                half += glm::abs(glm::vec3(transform[i])) * e[i];
+            }
+            return {c - half, c + half};
+        }
+    };
+
+    class StaticMesh : NonMovable
     {
 
     public:
         StaticMesh() = default;
-        StaticMesh(StaticMesh &&) = default;
-        StaticMesh &operator=(StaticMesh &&) = default;
-
-        StaticMesh(const MeshData &data);
+        // With position_stream, positions are also kept in the packed stream used by depth only passes
+        StaticMesh(const MeshData &data, bool position_stream = true);
+        ~StaticMesh();
 
+        // Binds a vertex array of the geometry arena, shared by all meshes.
+        // Without a position stream, positions are read from the attribute stream, at the same location.
+        void bind(VertexStream stream = VertexStream::Attributes) const;
         void draw() const;
-        void bind_enable() const;
-        const TypedBuffer<u32> &get_index_buffer() const
+        void draw_instanced(u32 instance_count, VertexStream stream = VertexStream::Attributes) const;
+
+        bool has_position_stream() const
+        {
+            return _position_stream;
+        }
+
+        const GeometryAllocation &geometry() const
+        {
+            return _geometry;
+        }
+
+        // CPU copy of the geometry, kept only for meshes small enough to be used as occluders
+        Span<const glm::vec3> occluder_positions() const
+        {
+            return _occluder_positions;
+        }
+
+        Span<const u32> occluder_indices() const
         {
-            return _index_buffer;
+            return _occluder_indices;
         }
 
         BoundingSphere _bounding_sphere;
+        BoundingBox _bounding_box;
+
+        static constexpr size_t max_occluder_triangles = 4096;
 
     private:
-        TypedBuffer<Vertex> _vertex_buffer;
-        TypedBuffer<u32> _index_buffer;
+        std::vector<glm::vec3> _occluder_positions;
+        std::vector<u32> _occluder_indices;
+
+        std::shared_ptr<GeometryArena> _arena;
+        GeometryAllocation _geometry;
+        bool _position_stream = false;
     };
 
 }
@@ -1,5 +1,7 @@
 #include "Texture.h"
 
+#include <StateCache.h>
+
 #include <glad/glad.h>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -34,9 +36,9 @@ Result<TextureData> TextureData::from_file(const std::string& file) {
 
 
 
-static GLuint create_texture_handle() {
+static GLuint create_texture_handle(GLenum target = GL_TEXTURE_2D) {
     GLuint handle = 0;
-    glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+    glCreateTextures(target, 1, &handle);
     return handle;
 }
 
@@ -63,6 +65,21 @@ Texture::Texture(const TextureData& data) :
     glGenerateTextureMipmap(_handle.get());
 }
 
+Texture::Texture(Span<const TextureData* const> layers) :
+    _handle(create_texture_handle(GL_TEXTURE_2D_ARRAY)),
+    _size(layers[0]->size),
+    _layer_count(u32(layers.size())),
+    _format(layers[0]->format) {
+
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    glTextureStorage3D(_handle.get(), mip_levels(_size), gl_format.internal_format, _size.x, _size.y, _layer_count);
+    for(u32 i = 0; i != _layer_count; ++i) {
+        ALWAYS_ASSERT(layers[i]->size == _size && layers[i]->format == _format, "Texture array layers must have the same size and format");
+        glTextureSubImage3D(_handle.get(), 0, 0, 0, i, _size.x, _size.y, 1, gl_format.format, gl_format.component_type, layers[i]->data.get());
+    }
+    glGenerateTextureMipmap(_handle.get());
+}
+
 Texture::Texture(const glm::uvec2 &size, ImageFormat format) :
     _handle(create_texture_handle()),
     _size(size),
@@ -79,8 +96,7 @@ Texture::Texture(const glm::uvec2 &size, ImageFormat format, int value) :
     
     const ImageFormatGL gl_format = image_format_to_gl(_format);
     glTextureStorage2D(_handle.get(), 1, gl_format.internal_format, _size.x, _size.y);
-    std::vector<int> data(size.x * size.y, value);
-    glTextureSubImage2D(_handle.get(), 0, 0, 0, _size.x, _size.y, gl_format.format, gl_format.component_type, data.data());
+    glClearTexImage(_handle.get(), 0, gl_format.format, gl_format.component_type, &value);
 }
 
 Texture::Texture(const size_t buffer_size, ImageFormat format) :
@@ -95,8 +111,25 @@ Texture::Texture(const size_t buffer_size, ImageFormat format) :
     glTextureBuffer(_handle.get(), gl_format.internal_format, _buffer_handle.get());
 }
 
+Texture::Texture(const glm::uvec3 &size, ImageFormat format, const void* data) :
+    _handle(create_texture_handle(GL_TEXTURE_3D)),
+    _size(size),
+    _layer_count(size.z),
+    _format(format) {
+
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    glTextureStorage3D(_handle.get(), 1, gl_format.internal_format, size.x, size.y, size.z);
+    glTextureSubImage3D(_handle.get(), 0, 0, 0, 0, size.x, size.y, size.z, gl_format.format, gl_format.component_type, data);
+    glTextureParameteri(_handle.get(), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(_handle.get(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(_handle.get(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(_handle.get(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(_handle.get(), GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
 Texture::~Texture() {
     if(auto handle = _handle.get()) {
+        forget_texture(handle);
         glDeleteTextures(1, &handle);
     }
     if(auto handle = _buffer_handle.get()) {
@@ -105,7 +138,7 @@ Texture::~Texture() {
 }
 
 void Texture::bind(u32 index) const {
-    glBindTextureUnit(index, _handle.get());
+    bind_texture_unit(index, _handle.get());
 }
 
 void Texture::bind_as_image(u32 index, AccessType access) {
@@ -121,6 +154,10 @@ const glm::uvec2& Texture::size() const {
     return _size;
 }
 
+u32 Texture::layer_count() const {
+    return _layer_count;
+}
+
 const int Texture::buffer_size() const {
     return _buffer_size;
 }
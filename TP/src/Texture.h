@@ -5,6 +5,7 @@
 #include <ImageFormat.h>
 
 #include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
 
 #include <vector>
 #include <memory>
@@ -30,15 +31,21 @@ class Texture {
         ~Texture();
 
         Texture(const TextureData& data);
+        // 2D texture array, all layers must have the same size and format
+        Texture(Span<const TextureData* const> layers);
         Texture(const glm::uvec2 &size, ImageFormat format);
         Texture(const glm::uvec2 &size, ImageFormat format, int value);
         Texture(const size_t buffer_size, ImageFormat format); // Texture Buffer
+        // 3D texture with linear filtering and clamped to the edges, data is tightly packed in the component type of the format
+        Texture(const glm::uvec3 &size, ImageFormat format, const void* data);
 
         void bind(u32 index) const;
         void bind_as_image(u32 index, AccessType access);
         void bind_as_buffer(u32 index) const;
 
         const glm::uvec2& size() const;
+        // Layers of a 2D array, or depth of a 3D texture
+        u32 layer_count() const;
         const int buffer_size() const;
 
         const GLHandle &handle() const;
@@ -50,6 +57,7 @@ class Texture {
 
         GLHandle _handle;
         glm::uvec2 _size = {};
+        u32 _layer_count = 1;
         size_t _buffer_size;
         GLHandle _buffer_handle;
         ImageFormat _format;
@@ -0,0 +1,47 @@
+#include "TexturePacker.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace OM3D {
+
+u32 TexturePacker::add(TextureData data) {
+    _textures.push_back(std::move(data));
+    return u32(_textures.size() - 1);
+}
+
+std::vector<PackedTexture> TexturePacker::pack() const {
+    int max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+    // Ordered to keep the packing deterministic
+    std::map<std::tuple<u32, u32, u32>, std::vector<u32>> buckets;
+    for(u32 i = 0; i != _textures.size(); ++i) {
+        const TextureData& data = _textures[i];
+        buckets[{data.size.x, data.size.y, u32(data.format)}].push_back(i);
+    }
+
+    std::vector<PackedTexture> packed(_textures.size());
+    for(const auto& [key, indices] : buckets) {
+        for(size_t begin = 0; begin < indices.size(); begin += size_t(max_layers)) {
+            const size_t end = std::min(indices.size(), begin + size_t(max_layers));
+
+            std::vector<const TextureData*> layers;
+            for(size_t i = begin; i != end; ++i) {
+                layers.push_back(&_textures[indices[i]]);
+            }
+
+            const auto array = std::make_shared<Texture>(layers);
+            for(size_t i = begin; i != end; ++i) {
+                packed[indices[i]] = {array, u32(i - begin)};
+            }
+        }
+    }
+
+    return packed;
+}
+
+}
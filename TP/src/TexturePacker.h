@@ -0,0 +1,32 @@
+#ifndef TEXTUREPACKER_H
+#define TEXTUREPACKER_H
+
+#include <Texture.h>
+
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+// Layer of a texture array
+struct PackedTexture {
+    std::shared_ptr<Texture> array;
+    u32 layer = 0;
+};
+
+// Load time packer: textures with the same size and format are stored in the
+// same GL_TEXTURE_2D_ARRAY, so that materials using them can share draws.
+class TexturePacker : NonCopyable {
+    public:
+        // Returns the index of the texture in the result of pack()
+        u32 add(TextureData data);
+
+        std::vector<PackedTexture> pack() const;
+
+    private:
+        std::vector<TextureData> _textures;
+};
+
+}
+
+#endif // TEXTUREPACKER_H
@@ -23,6 +23,10 @@ class TypedBuffer : public ByteBuffer {
             return byte_size() / sizeof(T);
         }
 
+        void update(size_t first, Span<const T> data) {
+            update_bytes(first * sizeof(T), data.data(), data.size() * sizeof(T));
+        }
+
         BufferMapping<T> map(AccessType access = AccessType::ReadWrite) {
             return BufferMapping<T>(ByteBuffer::map_internal(access), byte_size(), handle());
         }
@@ -1,10 +1,14 @@
 #ifndef VERTEX_H
 #define VERTEX_H
 
+#include <utils.h>
+
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <cstddef>
+
 namespace OM3D {
 
 struct Vertex {
@@ -15,6 +19,32 @@ struct Vertex {
     glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f); // to avoid completly black meshes if no color is present
 };
 
+// Float attribute of Vertex, attribute i is read from location i by the vertex shaders
+struct VertexAttribute {
+    u32 components;
+    u32 offset;
+};
+
+#define VERTEX_ATTRIBUTE(member) VertexAttribute{u32(decltype(Vertex::member)::length()), u32(offsetof(Vertex, member))}
+
+inline constexpr VertexAttribute vertex_attributes[] = {
+    VERTEX_ATTRIBUTE(position),
+    VERTEX_ATTRIBUTE(normal),
+    VERTEX_ATTRIBUTE(uv),
+    VERTEX_ATTRIBUTE(tangent_bitangent_sign),
+    VERTEX_ATTRIBUTE(color),
+};
+
+#undef VERTEX_ATTRIBUTE
+
+static_assert([] {
+    u32 size = 0;
+    for(const VertexAttribute& attrib : vertex_attributes) {
+        size += attrib.components * u32(sizeof(float));
+    }
+    return size == sizeof(Vertex);
+}(), "Vertex attributes don't cover the whole vertex");
+
 }
 
 #endif // VERTEX_H
@@ -1,5 +1,7 @@
 #include "graphics.h"
 
+#include <StateCache.h>
+
 #include <glad/glad.h>
 
 #define GLFW_INCLUDE_NONE
@@ -38,6 +40,12 @@ u32 buffer_usage_to_gl(BufferUsage usage) {
             
         case BufferUsage::Atomic_counter:
             return GL_ATOMIC_COUNTER_BUFFER;
+
+        case BufferUsage::Indirect:
+            return GL_DRAW_INDIRECT_BUFFER;
+
+        case BufferUsage::DispatchIndirect:
+            return GL_DISPATCH_INDIRECT_BUFFER;
     }
 
     FATAL("Unknown usage value");
@@ -97,7 +105,7 @@ void init_graphics() {
     }
 
     glGenVertexArrays(1, &global_vao);
-    glBindVertexArray(global_vao);
+    bind_vertex_array(global_vao);
 
 }
 
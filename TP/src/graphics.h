@@ -47,7 +47,25 @@ enum class BufferUsage {
     Index,
     Uniform,
     Storage,
-    Atomic_counter
+    Atomic_counter,
+    Indirect,
+    DispatchIndirect
+};
+
+// Layout expected by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    u32 count;
+    u32 instance_count;
+    u32 first_index;
+    u32 base_vertex;
+    u32 base_instance;
+};
+
+// Layout expected by glDispatchComputeIndirect
+struct DispatchIndirectCommand {
+    u32 num_groups_x;
+    u32 num_groups_y;
+    u32 num_groups_z;
 };
 
 enum class AccessType {
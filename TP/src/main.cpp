@@ -4,6 +4,7 @@
 #include <GLFW/glfw3.h>
 
 #include <iostream>
+#include <random>
 #include <vector>
 
 #include <graphics.h>
@@ -11,6 +12,9 @@
 #include <Texture.h>
 #include <Framebuffer.h>
 #include <ImGuiRenderer.h>
+#include <OcclusionCuller.h>
+#include <FrameAllocator.h>
+#include <StateCache.h>
 #include <shader_structs.h>
 
 #include <imgui/imgui.h>
@@ -92,6 +96,7 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 255.0f, 255.0f));
         light.set_radius(40.0f);
         light.set_intensity(30.0f);
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
     {
@@ -100,6 +105,7 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 255.0f, 255.0f));
         light.set_radius(100.0f);
         light.set_intensity(50.0f);
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
 
@@ -109,6 +115,7 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 125.0f, 125.0f));
         light.set_radius(100.0f);
         light.set_intensity(50.0f);
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
 
@@ -118,6 +125,7 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 125.0f, 125.0f));
         light.set_radius(250.0f);
         light.set_intensity(30.0f);
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
 
@@ -127,6 +135,7 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 125.0f, 125.0f));
         light.set_radius(50.0f);
         light.set_intensity(30.0f);
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
 
@@ -136,6 +145,23 @@ void add_lights(std::unique_ptr<Scene>& scene)
         light.set_color(glm::vec3(255.0f, 125.0f, 125.0f));
         light.set_radius(80.0f);
         light.set_intensity(30.0f);
+        light.set_static(true);
+        scene->add_object(std::move(light));
+    }
+}
+
+// Many small lights scattered over the scene, like a city at night, to stress the light passes
+void add_random_lights(std::unique_ptr<Scene>& scene, size_t count) {
+    std::mt19937 rng(u32(scene->point_light_count()));
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const auto bounds = scene->bounds();
+    for(size_t i = 0; i != count; ++i) {
+        PointLight light;
+        light.set_position(glm::mix(bounds.min, bounds.max, glm::vec3(unit(rng), unit(rng), unit(rng))));
+        light.set_color(glm::vec3(255.0f, 150.0f + 105.0f * unit(rng), 75.0f + 180.0f * unit(rng)));
+        light.set_radius(5.0f + 20.0f * unit(rng));
+        light.set_intensity(0.02f + 0.2f * unit(rng));
+        light.set_static(true);
         scene->add_object(std::move(light));
     }
 }
@@ -150,9 +176,6 @@ std::unique_ptr<Scene> create_default_scene() {
     
     add_lights(scene);
 
-    // Order objects for instancing
-    scene->order_objects_in_lists();
-
     return scene;
 }
 
@@ -184,6 +207,7 @@ int main(int, char**) {
     ALWAYS_ASSERT(sphereSceneResult.is_ok, "Unable to load default scene");
     std::unique_ptr<Scene> sphere_scene = std::move(sphereSceneResult.value);
     SceneView sphere_scene_view(sphere_scene.get());
+    const std::shared_ptr<StaticMesh> sphere_mesh = sphere_scene->get_mesh(0);
 
 
     auto tonemap_program = Program::from_file("tonemap.comp");
@@ -191,7 +215,37 @@ int main(int, char**) {
     auto plight_program = Program::from_files("p_light.frag", "volume.vert");
     auto transparent_program = Program::from_files("transparency.frag", "transparency.vert", std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
     auto oit_compute_program = Program::from_file("transparency.comp");
-    auto tiled_program = Program::from_file("tiled.comp");
+    // The tile size of the tiled passes is their workgroup size, so each size is a separate program
+    std::array<std::shared_ptr<Program>, Scene::light_tile_sizes.size()> tiled_programs;
+    // Also light the sun, instead of deferred.frag
+    std::array<std::shared_ptr<Program>, Scene::light_tile_sizes.size()> fused_tiled_programs;
+    std::array<std::shared_ptr<Program>, Scene::light_tile_sizes.size()> light_culling_programs;
+    std::array<TileClassPrograms, Scene::light_tile_sizes.size()> tile_class_programs;
+    std::array<TileClassPrograms, Scene::light_tile_sizes.size()> fused_tile_class_programs;
+    // Define of the tiled.comp variant of each tile class, and whether it adds anything to deferred.frag
+    std::array<std::pair<std::string, bool>, tile_class_count> tile_classes;
+    tile_classes[size_t(TileClass::Sky)] = {"SKY_TILES", false};
+    tile_classes[size_t(TileClass::Sun)] = {"SUN_TILES", false};
+    tile_classes[size_t(TileClass::FewLights)] = {"FEW_LIGHT_TILES", true};
+    tile_classes[size_t(TileClass::ManyLights)] = {"MANY_LIGHT_TILES", true};
+    for(size_t i = 0; i != Scene::light_tile_sizes.size(); ++i) {
+        const std::array<std::string, 1> defines = {"TILE_SIZE_" + std::to_string(Scene::light_tile_sizes[i])};
+        const std::array<std::string, 2> fused_defines = {defines[0], "SUN_LIGHT"};
+        tiled_programs[i] = Program::from_file("tiled.comp", defines);
+        fused_tiled_programs[i] = Program::from_file("tiled.comp", fused_defines);
+        light_culling_programs[i] = Program::from_file("light_culling.comp", defines);
+
+        tile_class_programs[i].classification = Program::from_file("tile_classification.comp", defines);
+        fused_tile_class_programs[i].classification = tile_class_programs[i].classification;
+        for(size_t c = 0; c != tile_class_count; ++c) {
+            const auto& [class_define, adds_point_lights] = tile_classes[c];
+            if(adds_point_lights) {
+                tile_class_programs[i].lighting[c] = Program::from_file("tiled.comp", std::array<std::string, 2>{defines[0], class_define});
+            }
+            fused_tile_class_programs[i].lighting[c] = Program::from_file("tiled.comp", std::array<std::string, 3>{fused_defines[0], fused_defines[1], class_define});
+        }
+    }
+    auto light_clusters_program = Program::from_file("light_clusters.comp");
 
     auto deferred_mat = Material();
     deferred_mat.set_program(deferred_program);
@@ -217,16 +271,57 @@ int main(int, char**) {
     Texture albedo(window_size, ImageFormat::RGBA8_UNORM);
     Texture normals(window_size, ImageFormat::RGBA8_UNORM);
     Framebuffer g_buffer(&g_depth, std::array{&albedo, &normals});
+    Framebuffer depth_prepass_framebuffer(&g_depth);
     Framebuffer main_framebuffer(&g_depth, std::array{&lit});
 
-    Texture ll_buffer(window_size.x * window_size.y * 8, ImageFormat::RGBA_32UI);
+    TransparencyLists transparency_lists(window_size, window_size.x * window_size.y * 8);
     
     int nb_buffers = 3;
     Texture *buffers[] = { &albedo, &normals, &transparent };
     int buffer_index = 0;
     int force_transparency_group = -1;
-    std::shared_ptr<Material> last_material = nullptr;
     bool transparency_fb = false;
+    FrameAllocator frame_allocator;
+    OcclusionCuller occlusion_culler;
+    bool occlusion_culling = false;
+    bool use_pvs = false;
+    bool multi_draw = true;
+    bool depth_prepass = false;
+    bool gpu_light_culling = true;
+    // Index in Scene::light_tile_sizes
+    int light_tile_size_index = 1;
+    bool fused_lighting = true;
+    bool classify_tiles = true;
+    // Draw the point lights as light volumes instead of the tiled pass
+    bool light_volumes = false;
+    bool light_lod = false;
+    // Shade the static lights from the irradiance volume of the scene, once baked
+    bool baked_lights = false;
+    LightLodSettings light_lod_settings;
+    light_lod_settings.viewport_height = float(window_size.y);
+    // Shade the opaque objects in a single forward pass with the tile light lists, instead of the G-buffer and tiled passes
+    bool forward_plus = false;
+    StateChangeCounters state_changes;
+
+    // Samples written by the G-buffer pass, one query per frame in flight so that reading them never stalls
+    std::array<GLuint, FrameAllocator::frames_in_flight> g_buffer_queries = {};
+    glCreateQueries(GL_SAMPLES_PASSED, GLsizei(g_buffer_queries.size()), g_buffer_queries.data());
+    DEFER(glDeleteQueries(GLsizei(g_buffer_queries.size()), g_buffer_queries.data()));
+    // GPU time of the geometry pass (G-buffer or Forward+ depth pre-pass) and of the lighting passes
+    std::array<GLuint, FrameAllocator::frames_in_flight> geometry_queries = {};
+    glCreateQueries(GL_TIME_ELAPSED, GLsizei(geometry_queries.size()), geometry_queries.data());
+    DEFER(glDeleteQueries(GLsizei(geometry_queries.size()), geometry_queries.data()));
+    std::array<GLuint, FrameAllocator::frames_in_flight> lighting_queries = {};
+    glCreateQueries(GL_TIME_ELAPSED, GLsizei(lighting_queries.size()), lighting_queries.data());
+    DEFER(glDeleteQueries(GLsizei(lighting_queries.size()), lighting_queries.data()));
+    // Modes of the queries in flight, their results are read frames_in_flight frames later
+    std::array<bool, FrameAllocator::frames_in_flight> forward_plus_queries = {};
+    u32 query_frame = 0;
+    float g_buffer_overdraw = 0.0f;
+    float geometry_time = 0.0f;
+    float lighting_time = 0.0f;
+    // Estimated render target bytes of the opaque passes, in MB
+    float opaque_traffic = 0.0f;
     for(;;) {
         glfwPollEvents();
         if(glfwWindowShouldClose(window) || glfwGetKey(window, GLFW_KEY_ESCAPE)) {
@@ -239,51 +334,162 @@ int main(int, char**) {
             process_inputs(window, scene_view.camera());
         }
 
+        // Counts of the previous frame, including its GUI
+        state_changes = state_change_counters();
+        reset_state_change_counters();
+
+        frame_allocator.begin_frame();
+        const FrameContext frame = scene_view.begin_frame(frame_allocator, light_lod ? &light_lod_settings : nullptr, baked_lights);
+
+        const size_t query_index = query_frame % FrameAllocator::frames_in_flight;
+        if(query_frame >= FrameAllocator::frames_in_flight) {
+            // Issued frames_in_flight frames ago, begin_frame already waited for them
+            GLuint samples = 0;
+            glGetQueryObjectuiv(g_buffer_queries[query_index], GL_QUERY_RESULT, &samples);
+            const float pixels = float(window_size.x * window_size.y);
+            g_buffer_overdraw = float(samples) / pixels;
+
+            GLuint64 geometry_ns = 0;
+            glGetQueryObjectui64v(geometry_queries[query_index], GL_QUERY_RESULT, &geometry_ns);
+            geometry_time = float(geometry_ns) * 1e-6f;
+            GLuint64 lighting_ns = 0;
+            glGetQueryObjectui64v(lighting_queries[query_index], GL_QUERY_RESULT, &lighting_ns);
+            lighting_time = float(lighting_ns) * 1e-6f;
+
+            // Color targets only, the depth traffic of the geometry is about the same in both modes
+            float bytes = 0.0f;
+            if(forward_plus_queries[query_index]) {
+                // Shaded samples write lit (RGBA16F), the light culling reads the depth
+                bytes = float(samples) * 8.0f + pixels * 4.0f;
+            } else {
+                // Shaded samples write albedo and normals (RGBA8), the lighting reads them with the depth and writes lit.
+                // The separate sun pass writes lit once more and the tiled pass reads it back.
+                bytes = float(samples) * 8.0f + pixels * (12.0f + 8.0f);
+                if(!fused_lighting || light_volumes) {
+                    bytes += pixels * 16.0f;
+                }
+            }
+            opaque_traffic = bytes / (1024.0f * 1024.0f);
+        }
+        forward_plus_queries[query_index] = forward_plus;
+        ++query_frame;
+
+        const u32 tile_size = Scene::light_tile_sizes[light_tile_size_index];
+
         // Render the scene
         {
-            g_buffer.bind();
-            scene_view.render();
+
+            const DrawList draw_list = scene_view.cull(frame, occlusion_culling ? &occlusion_culler : nullptr, use_pvs);
+
+            glBeginQuery(GL_TIME_ELAPSED, geometry_queries[query_index]);
+            if(forward_plus) {
+                // Always with a depth pre-pass, which bounds the tiles for the light culling
+                main_framebuffer.bind();
+                depth_prepass_framebuffer.bind(false);
+                scene_view.render_depth(frame, draw_list, multi_draw);
+                glEndQuery(GL_TIME_ELAPSED);
+
+                glBeginQuery(GL_TIME_ELAPSED, lighting_queries[query_index]);
+                if(gpu_light_culling) {
+                    const std::shared_ptr<Program>& light_culling_program = light_culling_programs[light_tile_size_index];
+                    light_culling_program->bind();
+                    g_depth.bind(2);
+                    light_culling_program->set_uniform("window_size", window_size);
+                    scene_view.cull_lights(frame, window_size, tile_size);
+                }
+
+                main_framebuffer.bind(false);
+                glBeginQuery(GL_SAMPLES_PASSED, g_buffer_queries[query_index]);
+                scene_view.forward_render(frame, draw_list, window_size, tile_size, gpu_light_culling, multi_draw);
+                glEndQuery(GL_SAMPLES_PASSED);
+                glEndQuery(GL_TIME_ELAPSED);
+            } else {
+                g_buffer.bind();
+                if(depth_prepass) {
+                    depth_prepass_framebuffer.bind(false);
+                    scene_view.render_depth(frame, draw_list, multi_draw);
+                    g_buffer.bind(false);
+                }
+
+                glBeginQuery(GL_SAMPLES_PASSED, g_buffer_queries[query_index]);
+                scene_view.render(frame, draw_list, multi_draw, depth_prepass);
+                glEndQuery(GL_SAMPLES_PASSED);
+                glEndQuery(GL_TIME_ELAPSED);
+            }
         }
 
         // Deferred operations
-        {
-            deferred_mat.bind();
-            main_framebuffer.bind();
+        if(!forward_plus) {
+            glBeginQuery(GL_TIME_ELAPSED, lighting_queries[query_index]);
 
-            albedo.bind(0);
-            normals.bind(1);
-            g_depth.bind(2);
+            if(fused_lighting && !light_volumes) {
+                // The tiled pass writes all of lit, the framebuffer is still used by the transparent pass
+                main_framebuffer.bind(false);
+            } else {
+                deferred_mat.bind();
+                main_framebuffer.bind();
 
-            scene_view.deferred_render();
+                albedo.bind(0);
+                normals.bind(1);
+                g_depth.bind(2);
 
-            // Compute deferred contribution of each visible point lights
-            tiled_program->bind();
+                scene_view.deferred_render(frame);
+            }
 
-            lit.bind_as_image(0, AccessType::ReadWrite);
+            if(light_volumes) {
+                // Added over the sun pass, depth tested against the G-buffer depth
+                plight_mat.bind();
+
+                albedo.bind(0);
+                normals.bind(1);
+                g_depth.bind(2);
+
+                plight_mat.set_uniform("window_size", window_size);
+                scene_view.point_lights_render(frame, sphere_mesh);
+            } else {
+                // Build the light lists of the tiles from the depth buffer
+                if(gpu_light_culling) {
+                    const std::shared_ptr<Program>& light_culling_program = light_culling_programs[light_tile_size_index];
+                    light_culling_program->bind();
+                    g_depth.bind(2);
+                    light_culling_program->set_uniform("window_size", window_size);
+                    scene_view.cull_lights(frame, window_size, tile_size);
+                }
 
-            albedo.bind(0);
-            normals.bind(1);
-            g_depth.bind(2);
+                // Compute deferred contribution of each visible point lights
+                const std::shared_ptr<Program>& tiled_program = (fused_lighting ? fused_tiled_programs : tiled_programs)[light_tile_size_index];
+                tiled_program->bind();
 
-            uint tile_size = 10;
-            tiled_program->set_uniform("tile_size", tile_size);
-            tiled_program->set_uniform("window_size", window_size);
-            scene_view.tiled_render(window_size, tile_size);
+                lit.bind_as_image(0, AccessType::ReadWrite);
+
+                albedo.bind(0);
+                normals.bind(1);
+                g_depth.bind(2);
+
+                tiled_program->set_uniform("window_size", window_size);
+                const TileClassPrograms& classified_programs = (fused_lighting ? fused_tile_class_programs : tile_class_programs)[light_tile_size_index];
+                scene_view.tiled_render(frame, window_size, tile_size, gpu_light_culling, classify_tiles ? &classified_programs : nullptr);
+            }
+
+            glEndQuery(GL_TIME_ELAPSED);
         }
         
         // Render transparency
         {
-            // Forward rendering of transparent objects
-            Texture oit_head_list(window_size, ImageFormat::R32_UINT, 0);
+            // Forward rendering of transparent objects, shaded with the lights of their cluster
+            light_clusters_program->bind();
+            const LightClusters light_clusters = scene_view.build_light_clusters(frame, window_size);
+
             g_depth.bind(2);
-            scene_view.render_transparent(oit_head_list, ll_buffer, transparency_fb);
+            scene_view.render_transparent(frame, light_clusters, transparency_lists, transparency_fb);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
             // Compute to sort pixels values
             oit_compute_program->bind(); 
             lit.bind(0); // Bind actual result 
-            oit_head_list.bind_as_image(0, AccessType::ReadOnly); 
+            transparency_lists.head_list.bind_as_image(1, AccessType::ReadOnly); 
             transparent.bind_as_image(2, AccessType::WriteOnly); // Will write result on color image
-            ll_buffer.bind_as_buffer(0);
+            transparency_lists.nodes.bind_as_buffer(0);
             glDispatchCompute(align_up_to(window_size.x, 8) / 8, align_up_to(window_size.y, 8) / 8, 1);
         }
 
@@ -315,7 +521,6 @@ int main(int, char**) {
                 } else {
                     scene = std::move(result.value);
                     add_lights(scene);
-                    scene->order_objects_in_lists();
                     scene_view = SceneView(scene.get());
                 }
             }
@@ -331,15 +536,66 @@ int main(int, char**) {
             ImGui::InputInt("Force transparency group", &new_group_force_transparency);
             if (new_group_force_transparency != force_transparency_group)
             {
-                scene->undo_transparency(last_material);
-                last_material = scene->force_transparency(transparent_program, new_group_force_transparency);
+                scene->undo_transparency();
+                scene->force_transparency(transparent_program, new_group_force_transparency);
                 force_transparency_group = new_group_force_transparency;
             }
 
             ImGui::Checkbox("Transparency front and back", &transparency_fb);
+
+            ImGui::Checkbox("Occlusion culling", &occlusion_culling);
+            if (occlusion_culling)
+                ImGui::Text("Occluders: %u, occluded: %u / %u", occlusion_culler.occluder_count(), occlusion_culler.occluded_count(), occlusion_culler.tested_count());
+
+            ImGui::Checkbox("Multi draw indirect", &multi_draw);
+            ImGui::Text("State changes: %u issued, %u filtered", state_changes.issued, state_changes.filtered);
+
+            ImGui::Checkbox("Forward+", &forward_plus);
+            ImGui::Checkbox("Depth pre-pass", &depth_prepass);
+            ImGui::Checkbox("GPU light culling", &gpu_light_culling);
+            ImGui::Combo("Light tile size", &light_tile_size_index, "8x8\0" "16x16\0" "32x32\0");
+            ImGui::Checkbox("Sun in tiled pass", &fused_lighting);
+            ImGui::Checkbox("Classify tiles", &classify_tiles);
+            ImGui::Checkbox("Light volumes", &light_volumes);
+            ImGui::Checkbox("Light LOD", &light_lod);
+            if(light_lod) {
+                ImGui::SliderFloat("Min light contribution", &light_lod_settings.min_contribution, 0.0f, 1024.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderFloat("Light merge size", &light_lod_settings.merge_size, 0.0f, 64.0f, "%.1f px");
+                ImGui::Text("Lights: %u shaded, %u dropped, %u merged", u32(frame.lights.size()), frame.dropped_lights, frame.merged_lights);
+            }
+            if(ImGui::Button("Add 10000 lights")) {
+                add_random_lights(scene, 10000);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%u lights", u32(scene->point_light_count()));
+            ImGui::Text("Geometry: %.3f ms, lighting: %.3f ms", geometry_time, lighting_time);
+            ImGui::Text("Opaque render targets: %.1f MB (estimate)", opaque_traffic);
+            ImGui::Text("%s overdraw: %.2f fragments per pixel", forward_plus ? "Forward+" : "G-buffer", g_buffer_overdraw);
+
+            if(ImGui::Button("Bake PVS")) {
+                scene->bake_pvs(scene->bounds(), glm::uvec3(8, 2, 8));
+            }
+            if(!scene->pvs().is_empty()) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Use PVS", &use_pvs);
+            }
+
+            if(ImGui::Button("Bake static lights")) {
+                // About 64 probes along the largest side of the scene
+                const auto bounds = scene->bounds();
+                const glm::vec3 extent = bounds.max - bounds.min;
+                const float spacing = std::max(extent.x, std::max(extent.y, extent.z)) / 64.0f;
+                scene->bake_static_lights(bounds, glm::max(glm::uvec3(glm::ceil(extent / spacing)), glm::uvec3(1)));
+            }
+            if(!scene->irradiance_volume().is_empty()) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Use baked lights", &baked_lights);
+            }
         }
         imgui.finish();
 
+        frame_allocator.end_frame();
+
         glfwSwapBuffers(window);
     }
 
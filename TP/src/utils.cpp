@@ -4,8 +4,11 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <thread>
+#include <vector>
 
 #ifdef OS_WIN
 #include <windows.h>
@@ -92,4 +95,19 @@ bool ends_with(std::string_view str, std::string_view suffix) {
     return str.substr(str.size() - suffix.size()) == suffix;
 }
 
+void parallel_for(size_t count, size_t min_chunk_size, const std::function<void(size_t, size_t)>& f) {
+    const size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    const size_t chunk_count = std::clamp(count / std::max(min_chunk_size, size_t(1)), size_t(1), max_threads);
+    const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+
+    std::vector<std::thread> threads;
+    for(size_t begin = chunk_size; begin < count; begin += chunk_size) {
+        threads.emplace_back(f, begin, std::min(begin + chunk_size, count));
+    }
+    f(0, std::min(chunk_size, count));
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
 }
@@ -4,6 +4,7 @@
 #include <defines.h>
 
 #include <cstdint>
+#include <functional>
 #include <utility>
 #include <string>
 #include <array>
@@ -200,6 +201,10 @@ inline constexpr T to_deg(T rad) {
 double program_time();
 Result<std::string> read_text_file(const std::string& file_name);
 
+// Split [0, count) in contiguous chunks of at least min_chunk_size elements, f(begin, end) is called
+// once per chunk on its own thread. Counts too small for two chunks run on the calling thread.
+void parallel_for(size_t count, size_t min_chunk_size, const std::function<void(size_t, size_t)>& f);
+
 bool ends_with(std::string_view str, std::string_view suffix);
 
 }
@@ -0,0 +1,65 @@
+#include <OcclusionCuller.h>
+#include <Camera.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace OM3D;
+
+// Frames of a city-like scene: a row of walls in front of a few thousand boxes, some of them behind the walls
+static constexpr u32 box_count = 4096;
+static constexpr u32 wall_count = 16;
+static constexpr u32 frame_count = 200;
+
+int main(int, char**) {
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    const u32 indices[] = {0, 1, 2, 0, 2, 3};
+    std::vector<std::array<glm::vec3, 4>> walls;
+    for(u32 i = 0; i != wall_count; ++i) {
+        const float x = (float(i) - wall_count * 0.5f) * 6.0f;
+        const float z = -10.0f - float(i % 4) * 5.0f;
+        walls.push_back({glm::vec3(x, 0.0f, z), glm::vec3(x + 5.0f, 0.0f, z), glm::vec3(x + 5.0f, 8.0f, z), glm::vec3(x, 8.0f, z)});
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> x_dist(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> z_dist(-200.0f, -5.0f);
+    std::uniform_real_distribution<float> size_dist(0.5f, 3.0f);
+    std::vector<BoundingBox> boxes;
+    for(u32 i = 0; i != box_count; ++i) {
+        const glm::vec3 min = glm::vec3(x_dist(rng), 0.0f, z_dist(rng));
+        boxes.push_back(BoundingBox{min, min + glm::vec3(size_dist(rng), size_dist(rng), size_dist(rng))});
+    }
+
+    OcclusionCuller culler;
+    double raster_ms = 0.0;
+    double test_ms = 0.0;
+    u32 occluded = 0;
+    for(u32 frame = 0; frame != frame_count; ++frame) {
+        const auto begin = std::chrono::high_resolution_clock::now();
+        culler.clear(camera.view_proj_matrix());
+        for(const auto& wall : walls) {
+            culler.add_occluder(wall, indices, glm::mat4(1.0f));
+        }
+
+        const auto rasterized = std::chrono::high_resolution_clock::now();
+        for(const BoundingBox& box : boxes) {
+            culler.is_occluded(box);
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        raster_ms += std::chrono::duration<double, std::milli>(rasterized - begin).count();
+        test_ms += std::chrono::duration<double, std::milli>(end - rasterized).count();
+        occluded = culler.occluded_count();
+    }
+
+    std::printf("%u occluders, %u boxes, %u occluded\n", wall_count, box_count, occluded);
+    std::printf("rasterization: %.3f ms, box tests: %.3f ms (%.1f ns per box)\n",
+        raster_ms / frame_count, test_ms / frame_count, test_ms * 1.0e6 / (double(frame_count) * box_count));
+    return 0;
+}
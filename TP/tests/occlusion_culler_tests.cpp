@@ -0,0 +1,104 @@
+#include <OcclusionCuller.h>
+#include <Camera.h>
+
+#include <cstdio>
+
+using namespace OM3D;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                     \
+        }                                                                   \
+    } while(false)
+
+// Camera at the origin looking down -z, with the infinite reverse-Z projection of the renderer
+static glm::mat4 view_proj() {
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    return camera.view_proj_matrix();
+}
+
+static void add_quad(OcclusionCuller& culler, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d) {
+    const glm::vec3 positions[] = {a, b, c, d};
+    const u32 indices[] = {0, 1, 2, 0, 2, 3};
+    culler.add_occluder(positions, indices, glm::mat4(1.0f));
+}
+
+// Wall facing the camera, covering [-5, 5] on x and y
+static void add_wall(OcclusionCuller& culler, float z) {
+    add_quad(culler, {-5.0f, -5.0f, z}, {5.0f, -5.0f, z}, {5.0f, 5.0f, z}, {-5.0f, 5.0f, z});
+}
+
+static BoundingBox box(const glm::vec3& min, const glm::vec3& max) {
+    return BoundingBox{min, max};
+}
+
+static void test_no_occluder() {
+    OcclusionCuller culler;
+    culler.clear(view_proj());
+    CHECK(!culler.is_occluded(box({-1.0f, -1.0f, -21.0f}, {1.0f, 1.0f, -19.0f})));
+}
+
+static void test_full_occlusion() {
+    OcclusionCuller culler;
+    culler.clear(view_proj());
+    add_wall(culler, -10.0f);
+    CHECK(culler.is_occluded(box({-1.0f, -1.0f, -21.0f}, {1.0f, 1.0f, -19.0f})));
+    // Large but still entirely inside the shadow of the wall
+    CHECK(culler.is_occluded(box({-8.0f, -8.0f, -40.0f}, {8.0f, 8.0f, -30.0f})));
+    CHECK(culler.occluded_count() == 2);
+}
+
+static void test_partial_occlusion() {
+    OcclusionCuller culler;
+    culler.clear(view_proj());
+    add_wall(culler, -10.0f);
+    // The wall covers [-10, 10] at z = -20, these boxes stick out of it
+    CHECK(!culler.is_occluded(box({8.0f, -1.0f, -21.0f}, {12.0f, 1.0f, -19.0f})));
+    CHECK(!culler.is_occluded(box({-1.0f, 9.0f, -21.0f}, {1.0f, 13.0f, -19.0f})));
+    // Next to the wall
+    CHECK(!culler.is_occluded(box({14.0f, -1.0f, -21.0f}, {16.0f, 1.0f, -19.0f})));
+}
+
+static void test_occluder_behind() {
+    OcclusionCuller culler;
+    culler.clear(view_proj());
+    add_wall(culler, -10.0f);
+    CHECK(!culler.is_occluded(box({-1.0f, -1.0f, -6.0f}, {1.0f, 1.0f, -4.0f})));
+    // Intersects the wall
+    CHECK(!culler.is_occluded(box({-1.0f, -1.0f, -11.0f}, {1.0f, 1.0f, -9.0f})));
+}
+
+static void test_near_plane() {
+    OcclusionCuller culler;
+    culler.clear(view_proj());
+    add_wall(culler, -10.0f);
+    // Behind the wall but also around the camera
+    CHECK(!culler.is_occluded(box({-1.0f, -1.0f, -20.0f}, {1.0f, 1.0f, 0.5f})));
+    CHECK(!culler.is_occluded(box({-1.0f, -1.0f, 1.0f}, {1.0f, 1.0f, 2.0f})));
+
+    // Floor below the camera, extending behind it: clipped by the near plane but still occludes what is under it
+    culler.clear(view_proj());
+    add_quad(culler, {-50.0f, -1.0f, 5.0f}, {50.0f, -1.0f, 5.0f}, {50.0f, -1.0f, -50.0f}, {-50.0f, -1.0f, -50.0f});
+    CHECK(culler.is_occluded(box({-2.0f, -5.0f, -20.0f}, {2.0f, -3.0f, -15.0f})));
+    CHECK(!culler.is_occluded(box({-2.0f, 0.0f, -20.0f}, {2.0f, 2.0f, -15.0f})));
+}
+
+int main(int, char**) {
+    test_no_occluder();
+    test_full_occlusion();
+    test_partial_occlusion();
+    test_occluder_behind();
+    test_near_plane();
+
+    if(failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All occlusion culler tests passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <PotentiallyVisibleSet.h>
+
+#include <cstdio>
+#include <vector>
+
+using namespace OM3D;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                     \
+        }                                                                   \
+    } while(false)
+
+// Closed unit cube, scaled and moved by the object transform
+static const glm::vec3 cube_positions[] = {
+    {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f, 1.0f},
+};
+static const u32 cube_indices[] = {
+    0, 2, 1, 0, 3, 2,
+    4, 5, 6, 4, 6, 7,
+    0, 1, 5, 0, 5, 4,
+    3, 7, 6, 3, 6, 2,
+    0, 4, 7, 0, 7, 3,
+    1, 2, 6, 1, 6, 5,
+};
+
+static BoundingBox box(const glm::vec3& min, const glm::vec3& max) {
+    return BoundingBox{min, max};
+}
+
+static PotentiallyVisibleSet::Object occluder(const glm::vec3& min, const glm::vec3& max) {
+    PotentiallyVisibleSet::Object object;
+    object.bounds = box(min, max);
+    object.occluder_positions = cube_positions;
+    object.occluder_indices = cube_indices;
+    object.transform = glm::translate(glm::mat4(1.0f), min) * glm::scale(glm::mat4(1.0f), max - min);
+    return object;
+}
+
+static PotentiallyVisibleSet::Object object(const glm::vec3& min, const glm::vec3& max) {
+    PotentiallyVisibleSet::Object object;
+    object.bounds = box(min, max);
+    return object;
+}
+
+static std::vector<u32> bake_single_cell(Span<const PotentiallyVisibleSet::Object> objects, const BoundingBox& cell, u32 samples_per_axis) {
+    const PotentiallyVisibleSet pvs = PotentiallyVisibleSet::bake(objects, cell, glm::uvec3(1), samples_per_axis);
+    std::vector<u32> bits;
+    pvs.decompress_cell(0, bits);
+    return bits;
+}
+
+// Thick wall covering x in [-10, 0], with an object on each side
+static std::vector<PotentiallyVisibleSet::Object> wall_scene() {
+    return {
+        occluder({-10.0f, 0.0f, -5.0f}, {0.0f, 10.0f, 5.0f}),
+        object({10.0f, 4.0f, -1.0f}, {12.0f, 6.0f, 1.0f}),
+        object({-22.0f, 4.0f, -1.0f}, {-20.0f, 6.0f, 1.0f}),
+    };
+}
+
+static void test_free_cell() {
+    const std::vector<PotentiallyVisibleSet::Object> objects = wall_scene();
+    const std::vector<u32> bits = bake_single_cell(objects, box({1.0f, 4.0f, -1.0f}, {3.0f, 6.0f, 1.0f}), 2);
+    CHECK(PotentiallyVisibleSet::is_set(bits, 0));
+    CHECK(PotentiallyVisibleSet::is_set(bits, 1));
+    CHECK(!PotentiallyVisibleSet::is_set(bits, 2));
+}
+
+static void test_cell_half_inside_occluder() {
+    const std::vector<PotentiallyVisibleSet::Object> objects = wall_scene();
+    // The center sample and half of the grid samples are inside the wall
+    const BoundingBox cell = box({-3.0f, 4.0f, -1.0f}, {1.4f, 6.0f, 1.0f});
+    for(u32 samples_per_axis = 1; samples_per_axis != 3; ++samples_per_axis) {
+        const std::vector<u32> bits = bake_single_cell(objects, cell, samples_per_axis);
+        CHECK(PotentiallyVisibleSet::is_set(bits, 0));
+        // Seen from the free half of the cell
+        CHECK(PotentiallyVisibleSet::is_set(bits, 1));
+        // Samples moved out of the wall still don't see through it
+        CHECK(!PotentiallyVisibleSet::is_set(bits, 2));
+    }
+}
+
+static void test_cell_inside_occluder() {
+    const std::vector<PotentiallyVisibleSet::Object> objects = wall_scene();
+    const std::vector<u32> bits = bake_single_cell(objects, box({-6.0f, 4.0f, -1.0f}, {-4.0f, 6.0f, 1.0f}), 2);
+    for(size_t i = 0; i != objects.size(); ++i) {
+        CHECK(PotentiallyVisibleSet::is_set(bits, i));
+    }
+}
+
+static void test_cell_inside_room() {
+    // Two opposite walls in one mesh: the center of the room is inside the bounds of the occluder but not inside of it
+    std::vector<glm::vec3> positions;
+    std::vector<u32> indices;
+    for(const float x : {-10.0f, 9.0f}) {
+        for(const u32 index : cube_indices) {
+            indices.push_back(index + u32(positions.size()));
+        }
+        for(const glm::vec3& pos : cube_positions) {
+            positions.push_back(glm::vec3(x, 0.0f, -10.0f) + pos * glm::vec3(1.0f, 10.0f, 20.0f));
+        }
+    }
+
+    PotentiallyVisibleSet::Object room;
+    room.bounds = box({-10.0f, 0.0f, -10.0f}, {10.0f, 10.0f, 10.0f});
+    room.occluder_positions = positions;
+    room.occluder_indices = indices;
+
+    const std::vector<PotentiallyVisibleSet::Object> objects = {
+        room,
+        object({20.0f, 4.0f, -1.0f}, {22.0f, 6.0f, 1.0f}),
+    };
+    const std::vector<u32> bits = bake_single_cell(objects, box({-1.0f, 4.0f, -1.0f}, {1.0f, 6.0f, 1.0f}), 1);
+    CHECK(PotentiallyVisibleSet::is_set(bits, 0));
+    // Would be visible if the sample was considered inside the occluder
+    CHECK(!PotentiallyVisibleSet::is_set(bits, 1));
+}
+
+int main(int, char**) {
+    test_free_cell();
+    test_cell_half_inside_occluder();
+    test_cell_inside_occluder();
+    test_cell_inside_room();
+
+    if(failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All PVS tests passed\n");
+    return 0;
+}